@@ -0,0 +1,190 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+/* Times every phase of a dump2dot run on the given dumps and writes the
+ * results as JSON: one object per dump with the seconds, item count,
+ * throughput and peak RSS of each phase */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "cmd_parse.h"
+#include "dump.h"
+
+namespace {
+    struct Phase {
+        std::string name;
+        double seconds;
+        double items;
+        const char *unit;
+        long peak_rss_kb;
+    };
+
+    long peak_rss_kb()
+    {
+#ifdef _WIN32
+        return 0;
+#else
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+#endif
+    }
+
+    double file_size(const std::string &path)
+    {
+        std::ifstream fi(path, std::ifstream::binary | std::ifstream::ate);
+        return fi.good() ? static_cast<double>(fi.tellg()) : 0;
+    }
+
+    template <typename F>
+    Phase measure(const std::string &name, const char *unit, F f)
+    {
+        auto start = std::chrono::steady_clock::now();
+        double items = f();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return { name, elapsed.count(), items, unit, peak_rss_kb() };
+    }
+
+    /* the names down the biggest children, so that find_node has some work to do */
+    std::vector<std::string> heavy_path(const MemoryDump &dump, size_t depth)
+    {
+        std::vector<std::string> path;
+        const std::vector<ChildNode> *level = &dump.top_level();
+        while (path.size() < depth && !level->empty()) {
+            const ChildNode *best = &level->front();
+            for (const auto & c : *level) {
+                if (c.node->subtree_size > best->node->subtree_size) best = &c;
+            }
+            path.push_back(best->node->name.str());
+            level = &best->node->children;
+        }
+        return path;
+    }
+
+    std::string json_string(const std::string &s)
+    {
+        std::string ret = "\"";
+        for (auto c : s) {
+            if (c == '"' || c == '\\') ret += '\\';
+            ret += c;
+        }
+        return ret + "\"";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> inputs;
+    std::string output = "bench.json";
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+            output = argv[++i];
+        }
+        else if (arg == "-h" || arg == "--help") {
+            inputs.clear();
+            break;
+        }
+        else {
+            inputs.push_back(arg);
+        }
+    }
+    if (inputs.empty()) {
+        std::cout << "Usage:" << std::endl
+            << argv[0] << " [-o result.json] dump..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream json(output, std::ofstream::trunc);
+    json << "[\n";
+    for (size_t n = 0; n < inputs.size(); n++) {
+        const auto &input = inputs[n];
+        std::vector<Phase> phases;
+        MemoryDump dump;
+
+        phases.push_back(measure("import", "bytes", [&]() {
+            dump.import(input);
+            return file_size(input);
+        }));
+        phases.push_back(measure("update_subtree_size", "nodes", [&]() {
+            dump.update_subtree_size(false);
+            return static_cast<double>(dump.node_count());
+        }));
+        phases.push_back(measure("set_critical", "nodes", [&]() {
+            dump.update_critical();
+            return static_cast<double>(dump.node_count());
+        }));
+
+        auto path = heavy_path(dump, 16);
+        phases.push_back(measure("find_node", "lookups", [&]() {
+            const int lookups = 1000;
+            for (int i = 0; i < lookups; i++) {
+                dump.find_node(path);
+            }
+            return static_cast<double>(lookups);
+        }));
+
+        const struct {
+            const char *name;
+            enum ExportType type;
+        } exporters[] = {
+            { "export_dot", EXPORT_DOT },
+            { "export_gml", EXPORT_GML },
+            { "export_graphml", EXPORT_GRAPHML }
+        };
+        cmd_opt opt;
+        opt.ofile = output + ".tmp";
+        for (const auto & e : exporters) {
+            opt.export_type = e.type;
+            phases.push_back(measure(e.name, "bytes", [&]() {
+                dump.write_output(opt);
+                return file_size(opt.ofile);
+            }));
+        }
+        std::remove(opt.ofile.c_str());
+
+        json << "  {\"input\": " << json_string(input)
+            << ", \"nodes\": " << dump.node_count()
+            << ", \"phases\": [\n";
+        for (size_t i = 0; i < phases.size(); i++) {
+            const auto &p = phases[i];
+            json << "    {\"phase\": " << json_string(p.name)
+                << ", \"seconds\": " << p.seconds
+                << ", \"" << p.unit << "\": " << static_cast<uint64_t>(p.items)
+                << ", \"" << p.unit << "_per_second\": " << (p.seconds > 0 ? p.items / p.seconds : 0)
+                << ", \"peak_rss_kb\": " << p.peak_rss_kb
+                << "}" << (i + 1 < phases.size() ? "," : "") << "\n";
+        }
+        json << "  ]}" << (n + 1 < inputs.size() ? "," : "") << "\n";
+    }
+    json << "]\n";
+    std::cout << "Results written to " << output << std::endl;
+    return EXIT_SUCCESS;
+}
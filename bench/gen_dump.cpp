@@ -0,0 +1,236 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+/* Synthetic heap dump generator, writes lines in the format MemoryDump::parse reads:
+ *
+ *     0xlabel,0xparent,kind,size,edge,name
+ *
+ * The heap is generated depth first, so that the ancestors of the current
+ * node are on the stack and cycles can be closed by pointing one of them
+ * back at the current node. Duplicate records give an existing node one
+ * more parent, as the interpreter does for shared series */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <random>
+#include <iostream>
+
+#include "kind.h"
+
+namespace {
+    struct Options {
+        uint64_t records;
+        int fanout;
+        int depth;
+        double dup_rate;
+        double cycle_rate;
+        int names;
+        uint64_t seed;
+        std::string output;
+        Options()
+            : records(1000000), fanout(4), depth(12),
+            dup_rate(0.05), cycle_rate(0.001), names(1000), seed(1)
+        {}
+    };
+
+    const int kinds[] = {
+        REB_BLOCK, REB_STRING, REB_OBJECT, REB_FUNCTION, REB_BINARY, REB_MAP,
+        REB_KIND_SERIES, REB_KIND_ARRAY, REB_KIND_CONTEXT, REB_KIND_KEYLIST,
+        REB_KIND_VARLIST, REB_KIND_HASH, REB_KIND_CHUNK, REB_KIND_CALL, REB_GOB
+    };
+
+    /* most edges are field names, the special ones change which parent is kept */
+    const char *edges[] = {
+        "(null)", "<keylist>", "<body>", "<spec>", "<pane>", "<varlist>", "<keeps>", "<bound-to>", "<parent>"
+    };
+    const size_t special_edges = 3;
+
+    void usage(const char *app)
+    {
+        std::cout << "Usage:" << std::endl
+            << app << " [options] output" << std::endl
+            << "-n, --records\tnumber\t\tRecords to write, k/M/G suffixes allowed (default 1M)" << std::endl
+            << "-f, --fanout\tnumber\t\tAverage children per node (default 4)" << std::endl
+            << "-d, --depth\tnumber\t\tMaximum depth below a root (default 12)" << std::endl
+            << "-u, --dup-rate\tfraction\tExtra records giving a node one more parent (default 0.05)" << std::endl
+            << "-c, --cycle-rate\tfraction\tExtra records pointing an ancestor back to a node (default 0.001)" << std::endl
+            << "-N, --names\tnumber\t\tDistinct names (default 1000)" << std::endl
+            << "-s, --seed\tnumber\t\tRandom seed (default 1)" << std::endl;
+    }
+
+    uint64_t parse_count(const char *text)
+    {
+        char *end = nullptr;
+        double n = std::strtod(text, &end);
+        switch (*end) {
+        case 'k': case 'K': n *= 1e3; break;
+        case 'm': case 'M': n *= 1e6; break;
+        case 'g': case 'G': n *= 1e9; break;
+        default: break;
+        }
+        return static_cast<uint64_t>(n);
+    }
+
+    bool parse_options(int argc, char **argv, Options &opt)
+    {
+        for (int i = 1; i < argc; i++) {
+            std::string arg(argv[i]);
+            bool has_value = i + 1 < argc;
+            if ((arg == "-n" || arg == "--records") && has_value) {
+                opt.records = parse_count(argv[++i]);
+            }
+            else if ((arg == "-f" || arg == "--fanout") && has_value) {
+                opt.fanout = std::max(1, std::atoi(argv[++i]));
+            }
+            else if ((arg == "-d" || arg == "--depth") && has_value) {
+                opt.depth = std::max(1, std::atoi(argv[++i]));
+            }
+            else if ((arg == "-u" || arg == "--dup-rate") && has_value) {
+                opt.dup_rate = std::atof(argv[++i]);
+            }
+            else if ((arg == "-c" || arg == "--cycle-rate") && has_value) {
+                opt.cycle_rate = std::atof(argv[++i]);
+            }
+            else if ((arg == "-N" || arg == "--names") && has_value) {
+                opt.names = std::max(1, std::atoi(argv[++i]));
+            }
+            else if ((arg == "-s" || arg == "--seed") && has_value) {
+                opt.seed = std::strtoull(argv[++i], nullptr, 10);
+            }
+            else if (arg[0] != '-' && opt.output.empty()) {
+                opt.output = arg;
+            }
+            else {
+                return false;
+            }
+        }
+        return !opt.output.empty();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::FILE *fo = std::fopen(opt.output.c_str(), "w");
+    if (fo == nullptr) {
+        std::cout << "Failed to open " << opt.output << std::endl;
+        return EXIT_FAILURE;
+    }
+    static char obuf[1 << 20];
+    std::setvbuf(fo, obuf, _IOFBF, sizeof(obuf));
+
+    std::mt19937_64 rng(opt.seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::uniform_int_distribution<int> fanout(0, 2 * opt.fanout);
+    std::uniform_int_distribution<size_t> kind(0, sizeof(kinds) / sizeof(kinds[0]) - 1);
+    std::uniform_int_distribution<size_t> edge(0, sizeof(edges) / sizeof(edges[0]) - 1);
+    std::uniform_int_distribution<size_t> common_edge(0, sizeof(edges) / sizeof(edges[0]) - 1 - special_edges);
+    std::lognormal_distribution<double> size(4.5, 1.5);
+
+    /* names are Zipf-like: a few very common ones and a long tail */
+    auto name = [&]() {
+        return static_cast<int>(std::pow(static_cast<double>(opt.names), uniform(rng))) - 1;
+    };
+    /* a node keeps its kind, size and name in every record of it, and the
+     * labels are laid out one after the other by size, 16-byte aligned like
+     * the allocator's, so that the layout report sees a packed heap */
+    struct Node {
+        uint64_t label;
+        uint32_t size;
+        int kind;
+        int name;
+    };
+    std::vector<Node> heap;
+    uint64_t next_label = 0x10000;
+    auto add_node = [&]() {
+        Node n;
+        n.label = next_label;
+        n.size = static_cast<uint32_t>(std::min(size(rng), 1e8));
+        n.kind = kinds[kind(rng)];
+        n.name = name();
+        next_label += std::max<uint64_t>(16, (n.size + 15) & ~static_cast<uint64_t>(15));
+        heap.push_back(n);
+        return heap.size() - 1;
+    };
+    auto emit = [&](uint64_t id, uint64_t parent, bool root) {
+        const auto &n = heap[id];
+        char plabel[24] = "(nil)";
+        if (!root) {
+            std::snprintf(plabel, sizeof(plabel), "0x%llx", static_cast<unsigned long long>(heap[parent].label));
+        }
+        std::fprintf(fo, "0x%llx,%s,%d,%u,%s,name%d\n",
+            static_cast<unsigned long long>(n.label),
+            plabel,
+            n.kind,
+            static_cast<unsigned>(n.size),
+            root ? "(null)" : edges[uniform(rng) < 0.05 ? edge(rng) : common_edge(rng)],
+            n.name);
+    };
+
+    struct Frame {
+        uint64_t id;
+        int children;
+    };
+    std::vector<Frame> stack;
+    uint64_t written = 0, nodes = 0, dups = 0, cycles = 0;
+    while (written < opt.records) {
+        if (stack.empty()) {
+            emit(add_node(), 0, true);
+            stack.push_back({ nodes++, fanout(rng) + 1 });
+            ++written;
+            continue;
+        }
+        auto &top = stack.back();
+        if (top.children == 0 || static_cast<int>(stack.size()) > opt.depth) {
+            stack.pop_back();
+            continue;
+        }
+        --top.children;
+        auto parent = top.id;
+        emit(add_node(), parent, false);
+        ++written;
+        stack.push_back({ nodes++, fanout(rng) });
+
+        if (opt.dup_rate > 0 && uniform(rng) < opt.dup_rate && nodes > 1) {
+            auto n = std::uniform_int_distribution<uint64_t>(1, nodes - 1)(rng);
+            auto p = std::uniform_int_distribution<uint64_t>(0, n - 1)(rng);
+            emit(n, p, false);
+            ++written;
+            ++dups;
+        }
+        if (opt.cycle_rate > 0 && uniform(rng) < opt.cycle_rate && stack.size() > 2) {
+            /* never the root, or its tree would hang off a cycle with no way in */
+            auto a = std::uniform_int_distribution<size_t>(1, stack.size() - 2)(rng);
+            emit(stack[a].id, stack.back().id, false);
+            ++written;
+            ++cycles;
+        }
+    }
+    std::fclose(fo);
+    std::cout << written << " records, " << nodes << " nodes, " << dups << " duplicates, "
+        << cycles << " cycles written to " << opt.output << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,236 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <cctype>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#include "dump.h"
+#include "edge_policy.h"
+#include "filter.h"
+#include "group.h"
+#include "batch.h"
+
+namespace {
+    bool split_words(const std::string &line, std::vector<std::string> &words)
+    {
+        words.clear();
+        size_t i = 0;
+        while (i < line.size()) {
+            while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i]))) ++i;
+            if (i == line.size() || line[i] == '#') break;
+            std::string word;
+            while (i < line.size() && !std::isspace(static_cast<unsigned char>(line[i]))) {
+                if (line[i] == '"' || line[i] == '\'') {
+                    auto end = line.find(line[i], i + 1);
+                    if (end == std::string::npos) return false;
+                    word += line.substr(i + 1, end - i - 1);
+                    i = end + 1;
+                }
+                else {
+                    word += line[i++];
+                }
+            }
+            words.push_back(word);
+        }
+        return true;
+    }
+
+    /* returns how many of them failed */
+    size_t write_outputs(MemoryDump &dump, const std::vector<const cmd_opt*> &exports, int jobs)
+    {
+        size_t failed = 0;
+#ifdef _WIN32
+        for (auto opt : exports) {
+            if (!dump.write_output(*opt)) ++failed;
+        }
+#else
+        /* the children share the sized dump copy-on-write, and only the pages
+         * holding the visited marks of the nodes they export get copied */
+        std::cout.flush();
+        size_t next = 0;
+        int running = 0;
+        while (next < exports.size() || running > 0) {
+            while (running < jobs && next < exports.size()) {
+                const auto &opt = *exports[next++];
+                auto pid = fork();
+                if (pid == 0) {
+                    bool ok = dump.write_output(opt);
+                    std::cout.flush();
+                    _exit(ok ? 0 : 1);
+                }
+                else if (pid < 0) {
+                    if (!dump.write_output(opt)) ++failed;
+                }
+                else {
+                    ++running;
+                }
+            }
+            if (running > 0) {
+                int status = 0;
+                if (wait(&status) < 0) break;
+                --running;
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) ++failed;
+            }
+        }
+#endif
+        return failed;
+    }
+}
+
+bool BatchRunner::read_spec(const std::string &path, const cmd_opt &base, std::vector<cmd_opt> &exports)
+{
+    std::ifstream fi(path);
+    if (!fi.good()) {
+        std::cout << "Failed to open " << path << std::endl;
+        return false;
+    }
+    std::string line;
+    std::vector<std::string> words;
+    size_t n = 0;
+    while (std::getline(fi, line)) {
+        ++n;
+        if (!split_words(line, words)) {
+            std::cout << path << ":" << n << ": unterminated quote" << std::endl;
+            return false;
+        }
+        if (words.empty()) continue;
+
+        std::vector<char*> argv(1, const_cast<char*>("batch"));
+        for (auto &w : words) {
+            argv.push_back(&w[0]);
+        }
+        cmd_opt opt = base;
+        opt.ofile.clear();
+        opt.ifile.clear();
+        opt.ifiles.clear();
+        int ret;
+        try {
+            ret = opt.parse(static_cast<int>(argv.size()), argv.data());
+        }
+        catch (...) {
+            ret = -1;
+        }
+        if (ret != 0 || !opt.ifile.empty() || opt.ofile.empty()) {
+            std::cout << path << ":" << n << ": "
+                << (ret != 0 ? "invalid options" : opt.ofile.empty() ? "no output file (-o)" : "no input file allowed")
+                << std::endl;
+            return false;
+        }
+        /* these act on the import or on the whole dump, not on one
+         * export, so a line cannot change them */
+        const struct {
+            const char *name;
+            bool changed;
+        } global[] = {
+            {"--kind-report", opt.kind_report != base.kind_report},
+            {"--kind-breakdown", opt.kind_breakdown != base.kind_breakdown},
+            {"--layout", opt.layout_report != base.layout_report},
+            {"--heatmap", opt.heatmap_file != base.heatmap_file},
+            {"--page", opt.page_size != base.page_size},
+            {"--profile", opt.profile_file != base.profile_file},
+            {"-f", opt.follow_interval != base.follow_interval},
+            {"-M", opt.memory_budget != base.memory_budget},
+            {"--tmp-dir", opt.tmp_dir != base.tmp_dir},
+            {"-i", opt.use_index != base.use_index},
+            {"-s", opt.sample != base.sample},
+            {"--convert", opt.convert_file != base.convert_file},
+            {"--batch", opt.batch_file != base.batch_file},
+            {"--shard", opt.shard_dir != base.shard_dir},
+            {"-j", opt.jobs != base.jobs}
+        };
+        for (const auto &g : global) {
+            if (g.changed) {
+                std::cout << path << ":" << n << ": option " << g.name << " not supported in a batch" << std::endl;
+                return false;
+            }
+        }
+        EdgePolicy policy;
+        std::string error;
+        if (!policy.parse(opt.edge_policy, error)) {
+            std::cout << path << ":" << n << ": invalid edge policy: " << error << std::endl;
+            return false;
+        }
+        if (!opt.filter.empty()) {
+            NodeFilter filter;
+            if (!filter.parse(opt.filter)) {
+                std::cout << path << ":" << n << ": invalid filter: " << filter.parse_error() << std::endl;
+                return false;
+            }
+        }
+        if (!opt.group_by.empty()) {
+            GroupBy groups;
+            if (!groups.parse(opt.group_by)) {
+                std::cout << path << ":" << n << ": invalid group-by keys: " << groups.parse_error() << std::endl;
+                return false;
+            }
+        }
+        opt.ifile = base.ifile;
+        opt.ifiles = base.ifiles;
+        exports.push_back(opt);
+    }
+    return true;
+}
+
+bool BatchRunner::run(MemoryDump &dump, const std::vector<cmd_opt> &exports, int jobs)
+{
+    auto start = std::chrono::steady_clock::now();
+    if (jobs <= 0) {
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+    jobs = static_cast<int>(std::min<size_t>(jobs, std::max<size_t>(exports.size(), 1)));
+#ifdef _WIN32
+    jobs = 1;
+#endif
+    /* the exports are grouped by edge policy, the dump's own first. Every
+     * other policy reselects the parents of the nodes and resizes the dump
+     * once, without importing it again */
+    std::vector<std::string> policies(1, dump.current_edge_policy().str());
+    for (const auto &opt : exports) {
+        if (std::find(policies.begin(), policies.end(), opt.edge_policy) == policies.end()) {
+            policies.push_back(opt.edge_policy);
+        }
+    }
+    size_t failed = 0;
+    for (const auto &text : policies) {
+        std::vector<const cmd_opt*> group;
+        for (const auto &opt : exports) {
+            if (opt.edge_policy == text) group.push_back(&opt);
+        }
+        if (group.empty()) continue;
+        if (text != dump.current_edge_policy().str()) {
+            EdgePolicy policy;
+            std::string error;
+            policy.parse(text, error); /* checked by read_spec() */
+            dump.set_edge_policy(policy);
+            std::cout << "Edges reselected by '" << text << "', total size: " << dump.reselect_edges() << std::endl;
+            dump.build_levels();
+        }
+        failed += write_outputs(dump, group, jobs);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << exports.size() - failed << " of " << exports.size() << " outputs written by "
+        << jobs << " jobs in " << elapsed.count() << " seconds" << std::endl;
+    return failed == 0;
+}
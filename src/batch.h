@@ -0,0 +1,47 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_BATCH_H
+#define D2D_BATCH_H
+
+#include <string>
+#include <vector>
+
+#include "cmd_parse.h"
+
+class MemoryDump;
+
+/* --batch: many exports from one import. The spec file has one export per
+ * line, written as the options of the command line (quotes group words,
+ * '#' starts a comment):
+ *
+ *     -o system.dot -n "NIL;system" -t 0.01
+ *     -o chunks.gml -e GML --filter "kind=CHUNK && size>1M" -d 2
+ *
+ * Every line starts from the options given on the command line. A line
+ * with its own --edge-policy is written after the dump is re-parented by
+ * it (MemoryDump::reselect_edges()), once per distinct policy. Options
+ * about the import or the whole dump (--layout, --kind-report, -M, ...)
+ * are rejected, they only work on the command line. Up to
+ * `jobs' exports are written at once, each by a forked copy of the sized
+ * dump (one after the other where fork() is not available) */
+class BatchRunner {
+public:
+    static bool read_spec(const std::string &path, const cmd_opt &base, std::vector<cmd_opt> &exports);
+    static bool run(MemoryDump &dump, const std::vector<cmd_opt> &exports, int jobs);
+};
+
+#endif //D2D_BATCH_H
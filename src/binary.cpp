@@ -0,0 +1,203 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <vector>
+#include <unordered_map>
+
+#include "dump.h"
+#include "binary.h"
+
+namespace {
+    const char BINARY_MAGIC[4] = { 'D', '2', 'D', 'B' };
+}
+
+bool BinaryDump::is_binary(std::istream &is)
+{
+    char magic[sizeof(BINARY_MAGIC)];
+    auto pos = is.tellg();
+    is.read(magic, sizeof(magic));
+    bool ret = is.gcount() == sizeof(magic) && !std::memcmp(magic, BINARY_MAGIC, sizeof(magic));
+    is.clear();
+    is.seekg(pos);
+    return ret;
+}
+
+bool BinaryDump::convert(const std::string &text, const std::string &binary)
+{
+    std::ifstream fi(text);
+    std::ofstream fo(binary, std::ofstream::binary | std::ofstream::trunc);
+    if (!fi.good() || !fo.good()) {
+        std::cout << "Failed to open " << (fi.good() ? binary : text) << std::endl;
+        return false;
+    }
+
+    BinaryHeader header;
+    std::memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+    header.version = BINARY_VERSION;
+    header.record_count = 0;
+    fo.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<const std::string*> strings;
+    auto intern = [&](const std::string &s) {
+        auto iter = ids.find(s);
+        if (iter != ids.end()) return iter->second;
+        auto id = static_cast<uint32_t>(strings.size());
+        strings.push_back(&ids.insert(std::make_pair(s, id)).first->first);
+        return id;
+    };
+
+    std::vector<BinaryRecord> records;
+    records.reserve(1 << 16);
+    auto flush = [&]() {
+        fo.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(BinaryRecord));
+        header.record_count += records.size();
+        records.clear();
+    };
+
+    std::string line;
+    size_t i = 0;
+    DumpRecord rec;
+    while (std::getline(fi, line)) {
+        ++i;
+        Parse_Result parse_result;
+        try {
+            parse_result = parse_record(line.c_str(), rec);
+        }
+        catch (...) {
+            parse_result = PARSE_FAIL;
+        }
+        if (parse_result == PARSE_FAIL) {
+            std::cout << "Failed to parse line " << i << ": " << line << std::endl;
+            continue;
+        }
+        else if (parse_result == PARSE_COMMENT) {
+            continue;
+        }
+        BinaryRecord r;
+        r.label = rec.label;
+        r.parent = rec.parent;
+        r.kind = rec.kind;
+        r.size = rec.size;
+        r.edge = intern(rec.edge);
+        r.name = rec.has_name ? intern(rec.name) : BINARY_NULL_STRING;
+        records.push_back(r);
+        if (records.size() == records.capacity()) flush();
+    }
+    flush();
+
+    header.string_count = strings.size();
+    header.string_offset = sizeof(header) + header.record_count * sizeof(BinaryRecord);
+    for (auto s : strings) {
+        uint32_t len = static_cast<uint32_t>(s->size());
+        fo.write(reinterpret_cast<const char*>(&len), sizeof(len));
+        fo.write(s->data(), len);
+    }
+    fo.seekp(0);
+    fo.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!fo.good()) {
+        std::cout << "Failed to write " << binary << std::endl;
+        return false;
+    }
+    std::cout << header.record_count << " records and " << header.string_count
+        << " strings written to " << binary << std::endl;
+    return true;
+}
+
+bool BinaryDump::load(std::istream &is, MemoryDump &dump)
+{
+    BinaryHeader header;
+    is.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (is.gcount() != sizeof(header) || std::memcmp(header.magic, BINARY_MAGIC, sizeof(header.magic))) {
+        std::cout << "Not a binary dump" << std::endl;
+        return false;
+    }
+    if (header.version != BINARY_VERSION) {
+        std::cout << "Unsupported binary dump version " << header.version << std::endl;
+        return false;
+    }
+
+    /* intern the string table once, records then only copy StringBins */
+    std::vector<StringBin> strings;
+    std::vector<enum EdgePriority> priorities;
+    strings.reserve(header.string_count);
+    priorities.reserve(header.string_count);
+    is.seekg(header.string_offset);
+    std::string s;
+    for (uint64_t i = 0; i < header.string_count; i++) {
+        uint32_t len = 0;
+        is.read(reinterpret_cast<char*>(&len), sizeof(len));
+        s.resize(len);
+        is.read(&s[0], len);
+        if (!is.good()) {
+            std::cout << "Truncated string table" << std::endl;
+            return false;
+        }
+        strings.push_back(StringBin(s));
+        priorities.push_back(ParentNode(0, s).priority);
+    }
+
+    is.seekg(sizeof(header));
+    std::vector<BinaryRecord> records(1 << 16);
+    uint64_t left = header.record_count;
+    uint64_t bad = 0; /* records naming a string past the table, skipped */
+    while (left > 0) {
+        auto n = std::min<uint64_t>(left, records.size());
+        is.read(reinterpret_cast<char*>(records.data()), n * sizeof(BinaryRecord));
+        if (!is.good()) {
+            std::cout << "Truncated record section" << std::endl;
+            return false;
+        }
+        for (uint64_t i = 0; i < n; i++) {
+            const auto &r = records[i];
+            if (r.edge >= strings.size() || (r.name != BINARY_NULL_STRING && r.name >= strings.size())) {
+                ++bad;
+                continue;
+            }
+            ParentNode parent(r.parent, strings[r.edge], priorities[r.edge]);
+            auto iter = dump.nodes.find(r.label);
+            if (iter != dump.nodes.end()) {
+                iter->second.parents.insert(parent);
+                ++dump.stats.duplicates;
+                continue;
+            }
+            auto &node = dump.nodes[r.label];
+            node.label = r.label;
+            node.node_type = static_cast<enum Reb_Kind>(r.kind);
+            node.subtree_size = node.size = r.size;
+            if (r.name == BINARY_NULL_STRING) {
+                node.name.erase();
+            }
+            else {
+                node.name = strings[r.name];
+            }
+            node.parents.insert(parent);
+        }
+        left -= n;
+        if ((header.record_count - left) % (1 << 20) == 0) {
+            std::cout << "Imported " << header.record_count - left << " records" << std::endl;
+        }
+    }
+    if (bad > 0) {
+        std::cout << bad << " records with a bad string index skipped" << std::endl;
+    }
+    dump.stats.records = header.record_count;
+    std::cout << header.record_count << " records imported\n";
+    return true;
+}
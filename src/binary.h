@@ -0,0 +1,63 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_BINARY_H
+#define D2D_BINARY_H
+
+#include <cstdint>
+#include <string>
+#include <istream>
+
+class MemoryDump;
+
+/* Binary dump format, little endian:
+ *
+ *  header      BinaryHeader
+ *  records     record_count x BinaryRecord
+ *  strings     string_count x (uint32_t length, length bytes)
+ *
+ * Edges and names are indices into the string table, which holds every
+ * distinct string once. BINARY_NULL_STRING stands for "(null)" */
+class BinaryDump {
+public:
+    enum {
+        BINARY_VERSION = 1
+    };
+    static const uint32_t BINARY_NULL_STRING = 0xFFFFFFFF;
+
+    struct BinaryHeader {
+        char magic[4]; /* "D2DB" */
+        uint32_t version;
+        uint64_t record_count;
+        uint64_t string_count;
+        uint64_t string_offset; /* from the beginning of the file */
+    };
+
+    struct BinaryRecord {
+        uint64_t label;
+        uint64_t parent;
+        uint32_t kind;
+        uint32_t size;
+        uint32_t edge;
+        uint32_t name;
+    };
+
+    static bool is_binary(std::istream &is);
+    static bool convert(const std::string &text, const std::string &binary);
+    static bool load(std::istream &is, MemoryDump &dump);
+};
+
+#endif //D2D_BINARY_H
@@ -29,15 +29,43 @@ std::string cmd_opt::help(const char* app)
 {
     std::stringstream ss;
     ss << "Usage:" << std::endl
-        << app << " [options] input" << std::endl
+        << app << " [options] input..." << std::endl
+        << "input\t\t\t\tA text dump, plain, gzip or zstd, or a binary one; '-' or a FIFO streams a text dump." << std::endl
+        << "\t\t\t\tSeveral files or patterns ('heap-*.txt') are parsed concurrently (-j) into one graph" << std::endl
         << "-h, --help\t\t\tThis help" << std::endl
         << "-o, --output\tfile\t\tOutput file" << std::endl
         << "-t, --threshold\tnumber\t\tSpecify the minimum percent the node has to have to be shown" << std::endl
         << "-n, --node\tpath-to-node\tOutput only the subtree of the node (path needs to be ';' separated)" << std::endl
         << "-l, --label\t\tOutput only the subtree of the node identified by the label" << std::endl
+        << "--filter\texpression\tOutput the subtrees of the nodes matching, e.g. 'kind=CHUNK && size>1M && under=\"NIL;system\"'" << std::endl
+        << "\t\t\t\tFields: kind, size, subtree, name, edge, critical, under; operators: = != < <= > >= ~ ! && || ()" << std::endl
         << "-d, --depth\tinteger\t\tMax depth from the starting node" << std::endl
-        << "-e, --export\t[DOT|GML|GRAPHML]\tThe output file format" << std::endl
-        << "-c, --critical\t\t\tOutput critical path only" << std::endl;
+        << "-e, --export\t[DOT|GML|GRAPHML|FOLDED|JSON|COLUMNS]\tThe output file format (FOLDED: flame graph stacks, JSON: nested tree, COLUMNS: binary node/edge/string tables next to the output, which describes them)" << std::endl
+        << "-c, --critical\t\t\tOutput critical path only" << std::endl
+        << "--top\tnumber\t\tOutput only the paths from the top to the biggest subtrees" << std::endl
+        << "--why\tnumber\t\tOutput only this many shortest chains of references keeping the -l/-n nodes alive" << std::endl
+        << "--edge-policy\trules\t\tWhich parent edges to keep, e.g. '<bound-to>=ignore,GOB:<parent>=max,context=off'" << std::endl
+        << "--compress\tcodec[:level]\tCompress the output with none, gzip or zstd (default: by the extension, .gz or .zst)" << std::endl
+        << "--layout\tfile\t\tReport the address space: gaps, page fill, fragmentation and locality by kind, as JSON if the name ends in .json ('-' for stdout)" << std::endl
+        << "--page\t\tbytes\t\tPage or arena size of the layout report, k/M/G allowed (default 4k)" << std::endl
+        << "--heatmap\tfile\t\tDraw the page fill as a PPM image" << std::endl
+        << "--group-by\tkeys\t\tExport the graph of the nodes summed up by kind, edge, name and/or path[:N], e.g. 'path:2,edge'" << std::endl
+        << "--group-report\tfile\t\tList the --group-by groups, biggest first, as JSON if the name ends in .json ('-' for stdout)" << std::endl
+        << "--shard\tdirectory\tWrite the subtree of every top node (or child of -n/-l/--filter) above the threshold to its own file, listed in index.json (-j at once)" << std::endl
+        << "--batch\tfile\t\tImport once and write every export listed in the file, one line of options (-o, -n, -t, ...) each" << std::endl
+        << "-j, --jobs\tnumber\t\tExports --batch writes, or inputs parsed, at once (default: one per core)" << std::endl
+        << "--coarsen\t\t\tCollapse single-child chains and sum the children left out by -t/-m into \"N others\" nodes" << std::endl
+        << "--dedup\t\t\t\tDraw identical sibling subtrees once, the edge says how many there are" << std::endl
+        << "--others-by-kind\t\tLike --coarsen, with one \"others\" node per kind" << std::endl
+        << "-f, --follow\tseconds\t\tKeep reading records appended to the input and re-export every so often (SIGUSR1 re-exports immediately)" << std::endl
+        << "-M, --memory-budget\tMB\t\tImport out of core, sorting on disk with at most this much memory" << std::endl
+        << "-i, --index\t\t\tRead only the subtrees of -n/-l through input.idx (built on first use)" << std::endl
+        << "-s, --sample\tnumber\t\tOnly estimate the totals per kind and name, from this fraction (< 1) or number of records" << std::endl
+        << "--convert\tfile\t\tConvert the text input to a binary dump (read back automatically) and exit" << std::endl
+        << "--tmp-dir\tdir\t\tWhere the out of core import spills to (default $TMPDIR or /tmp)" << std::endl
+        << "--kind-breakdown\t\tTrack the bytes by kind of every subtree (shown by -e JSON and --kind-report)" << std::endl
+        << "--kind-report\tfile\t\tWrite the bytes by kind, overall and per selected subtree, as text ('-' for stdout) or .json" << std::endl
+        << "--profile\tfile\t\tWrite the time, counters and memory use of each phase as JSON ('-' for stdout), not of the --batch exports, which forked processes write" << std::endl;
 
     return ss.str();
 }
@@ -95,14 +123,87 @@ int cmd_opt::parse(int argc, char **argv)
             else if (arg == "-e" || arg == "--export") {
                 mode = CMD_EXPORT_ARG;
             }
+            else if (arg == "--dedup") {
+                dedup = true;
+            }
+            else if (arg == "--coarsen") {
+                coarsen = true;
+            }
+            else if (arg == "--others-by-kind") {
+                coarsen = others_by_kind = true;
+            }
             else if (arg == "-c" || arg == "--critical") {
                 critical_only = true;
             }
+            else if (arg == "-f" || arg == "--follow") {
+                mode = CMD_FOLLOW_ARG;
+            }
+            else if (arg == "-M" || arg == "--memory-budget") {
+                mode = CMD_MEMORY_BUDGET_ARG;
+            }
+            else if (arg == "-i" || arg == "--index") {
+                use_index = true;
+            }
+            else if (arg == "-s" || arg == "--sample") {
+                mode = CMD_SAMPLE_ARG;
+            }
+            else if (arg == "--convert") {
+                mode = CMD_CONVERT_ARG;
+            }
+            else if (arg == "--tmp-dir") {
+                mode = CMD_TMP_DIR_ARG;
+            }
+            else if (arg == "--profile") {
+                mode = CMD_PROFILE_ARG;
+            }
+            else if (arg == "--filter") {
+                mode = CMD_FILTER_ARG;
+            }
+            else if (arg == "--kind-breakdown") {
+                kind_breakdown = true;
+            }
+            else if (arg == "--kind-report") {
+                mode = CMD_KIND_REPORT_ARG;
+            }
+            else if (arg == "--top") {
+                mode = CMD_TOP_ARG;
+            }
+            else if (arg == "--why") {
+                mode = CMD_WHY_ARG;
+            }
+            else if (arg == "--edge-policy") {
+                mode = CMD_EDGE_POLICY_ARG;
+            }
+            else if (arg == "--batch") {
+                mode = CMD_BATCH_ARG;
+            }
+            else if (arg == "-j" || arg == "--jobs") {
+                mode = CMD_JOBS_ARG;
+            }
+            else if (arg == "--compress") {
+                mode = CMD_COMPRESS_ARG;
+            }
+            else if (arg == "--shard") {
+                mode = CMD_SHARD_ARG;
+            }
+            else if (arg == "--layout") {
+                mode = CMD_LAYOUT_ARG;
+            }
+            else if (arg == "--page") {
+                mode = CMD_PAGE_ARG;
+            }
+            else if (arg == "--heatmap") {
+                mode = CMD_HEATMAP_ARG;
+            }
+            else if (arg == "--group-by") {
+                mode = CMD_GROUP_BY_ARG;
+            }
+            else if (arg == "--group-report") {
+                mode = CMD_GROUP_REPORT_ARG;
+            }
             else {
-                if (!ifile.empty()) {
-                    return -3;
-                }
-                ifile = arg;
+                if (ifile.empty()) ifile = arg;
+                ifiles.push_back(arg);
             }
 
             break;
@@ -120,6 +221,135 @@ int cmd_opt::parse(int argc, char **argv)
         }
         mode = CMD_OPT;
         break;
+        case CMD_FOLLOW_ARG:
+        {
+            char *p = argv[i];
+            follow_interval = std::strtod(argv[i], &p);
+            if (p == argv[i] || follow_interval <= 0) {
+                return -11;
+            }
+        }
+        mode = CMD_OPT;
+        break;
+        case CMD_MEMORY_BUDGET_ARG:
+            try {
+                auto mb = std::stoi(argv[i]);
+                if (mb <= 0) return -12;
+                memory_budget = static_cast<size_t>(mb) << 20;
+            }
+            catch (...) {
+                return -12;
+            }
+            mode = CMD_OPT;
+            break;
+        case CMD_SAMPLE_ARG:
+        {
+            char *p = argv[i];
+            sample = std::strtod(argv[i], &p);
+            if (p == argv[i] || sample <= 0) {
+                return -13;
+            }
+        }
+        mode = CMD_OPT;
+        break;
+        case CMD_CONVERT_ARG:
+            convert_file = arg;
+            mode = CMD_OPT;
+            break;
+        case CMD_TMP_DIR_ARG:
+            tmp_dir = arg;
+            mode = CMD_OPT;
+            break;
+        case CMD_PROFILE_ARG:
+            profile_file = arg;
+            mode = CMD_OPT;
+            break;
+        case CMD_FILTER_ARG:
+            filter = arg;
+            mode = CMD_OPT;
+            break;
+        case CMD_TOP_ARG:
+            try {
+                top = std::stoi(argv[i]);
+                if (top <= 0) return -14;
+            }
+            catch (...) {
+                return -14;
+            }
+            mode = CMD_OPT;
+            break;
+        case CMD_WHY_ARG:
+            try {
+                why = std::stoi(argv[i]);
+                if (why <= 0) return -15;
+            }
+            catch (...) {
+                return -15;
+            }
+            mode = CMD_OPT;
+            break;
+        case CMD_LAYOUT_ARG:
+            layout_report = arg;
+            mode = CMD_OPT;
+            break;
+        case CMD_HEATMAP_ARG:
+            heatmap_file = arg;
+            mode = CMD_OPT;
+            break;
+        case CMD_PAGE_ARG:
+        {
+            char *end = nullptr;
+            double n = std::strtod(argv[i], &end);
+            switch (*end) {
+            case 'k': case 'K': n *= 1024; ++end; break;
+            case 'm': case 'M': n *= 1024 * 1024; ++end; break;
+            case 'g': case 'G': n *= 1024 * 1024 * 1024; ++end; break;
+            default: break;
+            }
+            if (end == argv[i] || *end != '\0' || n < 1) return -17;
+            page_size = static_cast<uint64_t>(n);
+        }
+            mode = CMD_OPT;
+            break;
+        case CMD_GROUP_BY_ARG:
+            group_by = arg;
+            mode = CMD_OPT;
+            break;
+        case CMD_GROUP_REPORT_ARG:
+            group_report = arg;
+            mode = CMD_OPT;
+            break;
+        case CMD_SHARD_ARG:
+            shard_dir = arg;
+            mode = CMD_OPT;
+            break;
+        case CMD_COMPRESS_ARG:
+            compress = arg;
+            mode = CMD_OPT;
+            break;
+        case CMD_BATCH_ARG:
+            batch_file = arg;
+            mode = CMD_OPT;
+            break;
+        case CMD_JOBS_ARG:
+            try {
+                jobs = std::stoi(argv[i]);
+                if (jobs < 0) return -16;
+            }
+            catch (...) {
+                return -16;
+            }
+            mode = CMD_OPT;
+            break;
+        case CMD_EDGE_POLICY_ARG:
+            edge_policy = arg;
+            mode = CMD_OPT;
+            break;
+        case CMD_KIND_REPORT_ARG:
+            kind_report = arg;
+            kind_breakdown = true;
+            mode = CMD_OPT;
+            break;
         case CMD_MAX_SUBNODES_ARG:
             try {
                 max_subnodes = std::stoi(argv[i]);
@@ -139,6 +369,8 @@ int cmd_opt::parse(int argc, char **argv)
             mode = CMD_OPT;
             break;
         case CMD_EXPORT_ARG:
+            tree_export = TREE_EXPORT_NONE;
+            columns_export = false;
             if (!strcasecmp("DOT", argv[i])) {
                 export_type = EXPORT_DOT;
             }
@@ -148,6 +380,15 @@ int cmd_opt::parse(int argc, char **argv)
             else if (!strcasecmp("GRAPHML", argv[i])) {
                 export_type = EXPORT_GRAPHML;
             }
+            else if (!strcasecmp("FOLDED", argv[i])) {
+                tree_export = TREE_EXPORT_FOLDED;
+            }
+            else if (!strcasecmp("JSON", argv[i])) {
+                tree_export = TREE_EXPORT_JSON;
+            }
+            else if (!strcasecmp("COLUMNS", argv[i])) {
+                columns_export = true;
+            }
             else {
                 return -4;
             }
@@ -170,6 +411,12 @@ int cmd_opt::parse(int argc, char **argv)
         }
     }
 
+    if (columns_conflict()) return -18;
     return 0;
 }
 
+bool cmd_opt::columns_conflict() const
+{
+    return columns_export && (top > 0 || why > 0 || !group_by.empty());
+}
+
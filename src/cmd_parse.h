@@ -20,6 +20,7 @@
 #include <vector>
 #include <string>
 #include "export.h"
+#include "export_tree.h"
 
 class cmd_opt {
 private:
@@ -31,27 +32,77 @@ private:
         CMD_MAX_SUBNODES_ARG,
         CMD_EXPORT_ARG,
         CMD_NODE_ARG,
-        CMD_LABEL_ARG
+        CMD_LABEL_ARG,
+        CMD_FOLLOW_ARG,
+        CMD_MEMORY_BUDGET_ARG,
+        CMD_TMP_DIR_ARG,
+        CMD_SAMPLE_ARG,
+        CMD_CONVERT_ARG,
+        CMD_PROFILE_ARG,
+        CMD_FILTER_ARG,
+        CMD_KIND_REPORT_ARG,
+        CMD_TOP_ARG,
+        CMD_WHY_ARG,
+        CMD_EDGE_POLICY_ARG,
+        CMD_BATCH_ARG,
+        CMD_JOBS_ARG,
+        CMD_COMPRESS_ARG,
+        CMD_SHARD_ARG,
+        CMD_GROUP_BY_ARG,
+        CMD_GROUP_REPORT_ARG,
+        CMD_LAYOUT_ARG,
+        CMD_PAGE_ARG,
+        CMD_HEATMAP_ARG
     };
 public:
     struct NodePath {
         std::vector<std::string> node;
         std::string literal;  /* for error report */
     };
-    std::string ifile;
+    std::string ifile; /* the first of ifiles */
+    std::vector<std::string> ifiles; /* files or patterns, see MultiImport */
     std::string ofile;
     double threshold;
     int depth;
     int max_subnodes;
     bool critical_only;
+    bool coarsen; /* collapse chains and sum up what -t/-m leave out into "others" nodes */
+    bool dedup; /* draw identical sibling subtrees once */
+    bool columns_export; /* -e COLUMNS, ColumnTables next to the output */
+    bool others_by_kind;
+    bool use_index;
+    double follow_interval; /* seconds between polls of the input, 0 to import once */
+    size_t memory_budget; /* bytes, import out of core if > 0 */
+    std::string tmp_dir;
+    std::string convert_file; /* write the input as a binary dump here and exit */
+    std::string profile_file; /* per-phase timings and counters as JSON, "-" for stdout */
+    double sample; /* fraction (< 1) or number of records to sample for a quick summary, 0 to import */
     enum ExportType export_type;
+    enum TreeExportType tree_export; /* replaces export_type unless TREE_EXPORT_NONE */
     std::vector<NodePath> nodes;
     std::vector<uintptr_t> labels;
+    std::string filter; /* NodeFilter expression selecting more roots */
+    bool kind_breakdown; /* track the bytes by kind of every subtree */
+    std::string kind_report;
+    int top; /* export the paths to this many biggest subtrees instead, if > 0 */
+    std::string batch_file; /* BatchRunner spec, one export per line */
+    int jobs; /* concurrent batch exports or input files, 0 for one per core */
+    std::string group_by; /* GroupBy keys, the export becomes the graph of the groups */
+    std::string group_report;
+    std::string layout_report; /* LayoutReport of the addresses */
+    std::string heatmap_file;
+    uint64_t page_size; /* granularity of the layout report */
+    std::string shard_dir; /* ShardExport, one output per root */
+    std::string compress; /* output codec[:level], see AsyncWriter::parse_codec */
+    std::string edge_policy; /* EdgePolicy rules, empty for the default */
+    int why; /* export this many shortest paths keeping the -l/-n nodes alive instead, if > 0 */
 
-    cmd_opt() : threshold(0), critical_only(false), depth(-1), max_subnodes(-1), export_type(EXPORT_DOT) {}
+    cmd_opt() : threshold(0), depth(-1), max_subnodes(-1), critical_only(false), coarsen(false), dedup(false), columns_export(false), others_by_kind(false), use_index(false), follow_interval(0), memory_budget(0), sample(0), export_type(EXPORT_DOT), tree_export(TREE_EXPORT_NONE), kind_breakdown(false), top(0), jobs(0), page_size(4096), why(0) {}
     std::string help(const char* app);
     void parse_node(const char *text);
     int parse(int argc, char **argv);
+    /* -e COLUMNS holds the graph of the nodes, --top, --why and --group-by export another one */
+    bool columns_conflict() const;
 };
 
 #endif //D2D_CMD_PARSE_H
@@ -0,0 +1,181 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include "columns.h"
+
+namespace {
+    const char NODES_MAGIC[4] = { 'D', '2', 'D', 'N' };
+    const char EDGES_MAGIC[4] = { 'D', '2', 'D', 'E' };
+    const char STRINGS_MAGIC[4] = { 'D', '2', 'D', 'S' };
+
+    struct FileCloser {
+        void operator () (std::FILE *f) const
+        {
+            std::fclose(f);
+        }
+    };
+    typedef std::unique_ptr<std::FILE, FileCloser> File;
+
+    template <typename T>
+    bool write_column(std::FILE *f, const std::vector<T> &column)
+    {
+        return column.empty() || std::fwrite(column.data(), sizeof(T), column.size(), f) == column.size();
+    }
+
+    template <typename T>
+    bool read_column(std::FILE *f, std::vector<T> &column, uint64_t rows)
+    {
+        column.resize(rows);
+        return rows == 0 || std::fread(column.data(), sizeof(T), rows, f) == rows;
+    }
+
+    bool write_header(std::FILE *f, const char *magic, uint64_t rows)
+    {
+        ColumnTables::ColumnHeader header;
+        std::memcpy(header.magic, magic, sizeof(header.magic));
+        header.version = ColumnTables::COLUMNS_VERSION;
+        header.rows = rows;
+        return std::fwrite(&header, sizeof(header), 1, f) == 1;
+    }
+
+    bool read_header(std::FILE *f, const char *magic, uint64_t &rows)
+    {
+        ColumnTables::ColumnHeader header;
+        if (std::fread(&header, sizeof(header), 1, f) != 1
+            || std::memcmp(header.magic, magic, sizeof(header.magic))
+            || header.version != ColumnTables::COLUMNS_VERSION) {
+            return false;
+        }
+        rows = header.rows;
+        return true;
+    }
+}
+
+uint32_t ColumnTables::intern(const std::string &s)
+{
+    auto iter = string_ids.find(s);
+    if (iter != string_ids.end()) return iter->second;
+    auto id = static_cast<uint32_t>(strings.size());
+    strings.push_back(s);
+    string_ids[s] = id;
+    return id;
+}
+
+void ColumnTables::clear()
+{
+    label.clear();
+    subtree_size.clear();
+    kind.clear();
+    size.clear();
+    name.clear();
+    critical.clear();
+    parent.clear();
+    child.clear();
+    edge.clear();
+    strings.clear();
+    string_ids.clear();
+}
+
+bool ColumnTables::write(const std::string &base, std::string &error) const
+{
+    File nodes(std::fopen((base + ".nodes").c_str(), "wb"));
+    File edges(std::fopen((base + ".edges").c_str(), "wb"));
+    File strs(std::fopen((base + ".strings").c_str(), "wb"));
+    if (!nodes || !edges || !strs) {
+        error = "failed to create " + base + (!nodes ? ".nodes" : !edges ? ".edges" : ".strings");
+        return false;
+    }
+
+    std::vector<uint64_t> offsets(1, 0);
+    offsets.reserve(strings.size() + 1);
+    for (const auto &s : strings) {
+        offsets.push_back(offsets.back() + s.size());
+    }
+    bool ok = write_header(nodes.get(), NODES_MAGIC, label.size())
+        && write_column(nodes.get(), label)
+        && write_column(nodes.get(), subtree_size)
+        && write_column(nodes.get(), kind)
+        && write_column(nodes.get(), size)
+        && write_column(nodes.get(), name)
+        && write_column(nodes.get(), critical)
+        && write_header(edges.get(), EDGES_MAGIC, parent.size())
+        && write_column(edges.get(), parent)
+        && write_column(edges.get(), child)
+        && write_column(edges.get(), edge)
+        && write_header(strs.get(), STRINGS_MAGIC, strings.size())
+        && write_column(strs.get(), offsets);
+    for (const auto &s : strings) {
+        ok = ok && std::fwrite(s.data(), 1, s.size(), strs.get()) == s.size();
+    }
+    ok = ok && std::fflush(nodes.get()) == 0 && std::fflush(edges.get()) == 0 && std::fflush(strs.get()) == 0;
+    if (!ok) error = "failed to write the tables of " + base;
+    return ok;
+}
+
+bool ColumnTables::read(const std::string &base, std::string &error)
+{
+    clear();
+    File nodes(std::fopen((base + ".nodes").c_str(), "rb"));
+    File edges(std::fopen((base + ".edges").c_str(), "rb"));
+    File strs(std::fopen((base + ".strings").c_str(), "rb"));
+    if (!nodes || !edges || !strs) {
+        error = "failed to open " + base + (!nodes ? ".nodes" : !edges ? ".edges" : ".strings");
+        return false;
+    }
+
+    uint64_t n = 0, e = 0, s = 0;
+    std::vector<uint64_t> offsets;
+    if (!read_header(nodes.get(), NODES_MAGIC, n)
+        || !read_column(nodes.get(), label, n)
+        || !read_column(nodes.get(), subtree_size, n)
+        || !read_column(nodes.get(), kind, n)
+        || !read_column(nodes.get(), size, n)
+        || !read_column(nodes.get(), name, n)
+        || !read_column(nodes.get(), critical, n)) {
+        error = "bad or truncated " + base + ".nodes";
+        return false;
+    }
+    if (!read_header(edges.get(), EDGES_MAGIC, e)
+        || !read_column(edges.get(), parent, e)
+        || !read_column(edges.get(), child, e)
+        || !read_column(edges.get(), edge, e)) {
+        error = "bad or truncated " + base + ".edges";
+        return false;
+    }
+    if (!read_header(strs.get(), STRINGS_MAGIC, s) || !read_column(strs.get(), offsets, s + 1)) {
+        error = "bad or truncated " + base + ".strings";
+        return false;
+    }
+    std::vector<char> bytes(offsets.back());
+    if (!bytes.empty() && std::fread(bytes.data(), 1, bytes.size(), strs.get()) != bytes.size()) {
+        error = "truncated " + base + ".strings";
+        return false;
+    }
+    strings.reserve(s);
+    for (uint64_t i = 0; i < s; i++) {
+        if (offsets[i] > offsets[i + 1] || offsets[i + 1] > bytes.size()) {
+            error = "bad string offsets in " + base + ".strings";
+            return false;
+        }
+        strings.push_back(std::string(bytes.data() + offsets[i], offsets[i + 1] - offsets[i]));
+        string_ids[strings.back()] = static_cast<uint32_t>(i);
+    }
+    return true;
+}
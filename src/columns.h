@@ -0,0 +1,84 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_COLUMNS_H
+#define D2D_COLUMNS_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* Node, edge and string tables of an export (-e COLUMNS), for bulk loading
+ * into analytics tools. Each table is its own file next to the -o file:
+ *
+ *  <base>.nodes    header, label u64[n], subtree_size f64[n], kind u32[n],
+ *                  size u32[n], name u32[n], critical u8[n]
+ *  <base>.edges    header, parent u64[n], child u64[n], edge u32[n]
+ *  <base>.strings  header, offset u64[n + 1], the bytes of the n strings
+ *
+ * The header is ColumnHeader, n its row count; everything is in the byte
+ * order of the machine that wrote it, columns are written and read with a
+ * single fwrite/fread each. Names and edges index the string table,
+ * NO_STRING for none. This file depends on nothing else in the tree, it is
+ * also built as the d2d-columns library */
+class ColumnTables {
+public:
+    enum {
+        COLUMNS_VERSION = 1
+    };
+    static const uint32_t NO_STRING = 0xFFFFFFFF;
+
+    struct ColumnHeader {
+        char magic[4]; /* "D2DN", "D2DE" or "D2DS" */
+        uint32_t version;
+        uint64_t rows;
+    };
+
+    std::vector<uint64_t> label;
+    std::vector<double> subtree_size;
+    std::vector<uint32_t> kind;
+    std::vector<uint32_t> size;
+    std::vector<uint32_t> name;
+    std::vector<uint8_t> critical;
+
+    std::vector<uint64_t> parent;
+    std::vector<uint64_t> child;
+    std::vector<uint32_t> edge;
+
+    std::vector<std::string> strings;
+
+private:
+    std::unordered_map<std::string, uint32_t> string_ids;
+public:
+    /* the id of `s' in the string table, added if it is new */
+    uint32_t intern(const std::string &s);
+    void clear();
+
+    bool write(const std::string &base, std::string &error) const;
+    bool read(const std::string &base, std::string &error);
+
+    size_t node_count() const
+    {
+        return label.size();
+    }
+    size_t edge_count() const
+    {
+        return parent.size();
+    }
+};
+
+#endif //D2D_COLUMNS_H
@@ -15,11 +15,17 @@
 */
 
 #include <iostream>
+#include <chrono>
 #include <fstream>
 #include <iomanip>
 #include <string>
 #include <cstring>
 #include <algorithm>
+#include <map>
+#include <cmath>
+#include <climits>
+#include <queue>
+#include <unordered_set>
 
 #include "cmd_parse.h"
 #include "dump.h"
@@ -28,11 +34,18 @@
 #include "export_graphml.h"
 #include "export_dot.h"
 #include "export_gml.h"
+#include "export_tree.h"
+#include "binary.h"
+#include "reader.h"
+#include "writer.h"
+#include "filter.h"
+#include "group.h"
+#include "edge_policy.h"
 
 std::vector<std::string> StringBin::array;
 std::unordered_map<std::string, std::pair<int, int>> StringBin::set;
 
-enum MemoryDump::Parse_Result MemoryDump::parse(const char *buf, Node &node)
+enum Parse_Result parse_record(const char *buf, DumpRecord &rec)
 {
     const char comma = ',';
     while (*buf == ' ' || *buf == '\t') buf++;
@@ -42,57 +55,138 @@ enum MemoryDump::Parse_Result MemoryDump::parse(const char *buf, Node &node)
     auto skip = buf[1] == 'x' ? 2 : 0;
     auto s = std::string(buf + skip, p - buf - skip);
     size_t pos = 0;
-    node.label = std::stoll(s, &pos, 16); /* skip '0x' */
+    rec.label = std::stoll(s, &pos, 16); /* skip '0x' */
     buf = p + 1;
 
     p = std::strchr(buf, comma);
     if (p == nullptr) return PARSE_FAIL;
     s = std::string(buf, p - buf);
-    uintptr_t plabel;
     if (s != "(nil)") {
-        plabel = std::stoll(s.substr(s[1] == 'x' ? 2 : 0), &pos, 16); /* skip '0x' */
+        rec.parent = std::stoll(s.substr(s[1] == 'x' ? 2 : 0), &pos, 16); /* skip '0x' */
     }
     else {
-        plabel = 0;
+        rec.parent = 0;
     }
 
     buf = p + 1;
 
     p = std::strchr(buf, comma);
     if (p == nullptr) return PARSE_FAIL;
-    node.node_type = static_cast<enum Reb_Kind>(std::stoi(std::string(buf, p - buf)));
+    rec.kind = static_cast<enum Reb_Kind>(std::stoi(std::string(buf, p - buf)));
     buf = p + 1;
 
     p = std::strchr(buf, comma);
     if (p == nullptr) return PARSE_FAIL;
-    node.subtree_size = node.size = std::stoi(std::string(buf, p - buf));
+    rec.size = std::stoi(std::string(buf, p - buf));
     buf = p + 1;
 
     p = std::strchr(buf, comma);
     if (p == nullptr) return PARSE_FAIL;
-    auto edge = std::string(buf, p - buf);
-    if (edge == "(null)") {
-        edge.erase();
+    rec.edge.assign(buf, p - buf);
+    if (rec.edge == "(null)") {
+        rec.edge.erase();
     }
     buf = p + 1;
 
-    node.parents.insert(ParentNode(plabel, edge));
-
-    if (!std::strcmp("(null)", buf)) {
-        node.name.erase();
+    rec.has_name = std::strcmp("(null)", buf) != 0;
+    if (rec.has_name) {
+        rec.name.assign(buf);
     }
     else {
-        node.name.str(buf);
+        rec.name.erase();
     }
 
     return PARSE_OK;
 }
 
+enum Parse_Result MemoryDump::parse(const char *buf, Node &node)
+{
+    DumpRecord rec;
+    auto ret = parse_record(buf, rec);
+    if (ret != PARSE_OK) return ret;
+    make_node(rec, node);
+    return PARSE_OK;
+}
+
+void MemoryDump::make_node(const DumpRecord &rec, Node &node)
+{
+    node.label = rec.label;
+    node.node_type = rec.kind;
+    node.subtree_size = node.size = rec.size;
+    node.parents.insert(ParentNode(rec.parent, rec.edge));
+
+    if (!rec.has_name) {
+        node.name.erase();
+    }
+    else {
+        node.name.str(rec.name);
+    }
+}
+
 void MemoryDump::reset()
 {
     total_size = min_size = 0;
     nodes.clear();
     top_nodes.clear();
+    dangling.clear();
+    import_path.clear();
+    import_offset = 0;
+    stats.reset();
+    kind_column.clear();
+    column_kind.clear();
+    kind_rows.clear();
+    frozen_edges.clear();
+    children_sorted = false;
+    hidden_sizes.clear();
+}
+
+void MemoryDump::report_progress(size_t i)
+{
+    if (i > 1000000) {
+        if (i % 1000000 == 0) {
+            std::cout << "Imported " << i << " lines" << std::endl;
+        }
+    }
+    else if (i > 100000) {
+        if (i % 100000 == 0) {
+            std::cout << "Imported " << i << " lines" << std::endl;
+        }
+    }
+    else if (i > 10000) {
+        if (i % 10000 == 0) {
+            std::cout << "Imported " << i << " lines" << std::endl;
+        }
+    }
+    else if (i > 1000) {
+        if (i % 1000 == 0) {
+            std::cout << "Imported " << i << " lines" << std::endl;
+        }
+    }
+    else {
+        if (i % 100 == 0) {
+            std::cout << "Imported " << i << " lines" << std::endl;
+        }
+    }
+}
+
+Node *MemoryDump::merge_node(const Node &node, bool &changed)
+{
+    auto iter = nodes.find(node.label);
+    if (iter != nodes.end()) {
+        //std::cout << "Duplicate nodes: " << node.label << std::endl;
+        ++stats.duplicates;
+        changed = false;
+        for (const auto & p : node.parents) {
+            if (iter->second.parents.insert(p).second) {
+                changed = true;
+            }
+        }
+        return &iter->second;
+    }
+    changed = true;
+    auto &n = nodes[node.label];
+    n = node;
+    return &n;
 }
 
 bool MemoryDump::import(const std::string &path)
@@ -106,105 +200,415 @@ bool MemoryDump::import(const std::string &path)
     std::cout << "sizeof(node): " << sizeof(Node) << std::endl;
 
     try {
-        std::ifstream fi(path);
-        size_t i = 0;
-        size_t s = 1024;
-        auto buf = new char[s];
-        while (fi.good()) {
-            fi.getline(buf, s);
+        Profile::Scope scope(profile, "parse");
+        /* a pipe has to be read once, without peeking at it first */
+        bool stream = BlockReader::is_stream(path);
+        std::ifstream fb;
+        if (!stream) fb.open(path, std::ifstream::binary);
+        if (!stream && BinaryDump::is_binary(fb)) {
+            if (!BinaryDump::load(fb, *this)) return false;
+            link_nodes();
+            return true;
+        }
+        fb.close();
 
+        size_t i = 0;
+        auto import_line = [&](const char *buf) {
             ++i;
             Node node;
             auto parse_result = parse(buf, node);
             if (parse_result == PARSE_FAIL) {
                 std::cout << "Failed to parse line " << i << ": " << buf << std::endl;
-                continue;
+                ++stats.parse_failures;
+                return;
             }
             else if (parse_result == PARSE_COMMENT) {
-                continue;
-            }
-            auto iter = nodes.find(node.label);
-            if (iter != nodes.end()) {
-                //std::cout << "Duplicate nodes: " << node.label << std::endl;
-                for (const auto & p : node.parents) {
-                    iter->second.parents.insert(p);
-                }
+                return;
             }
-            else {
-                nodes[node.label] = node;
-            }
-            if (i > 1000000) {
-                if (i % 1000000 == 0) {
-                    std::cout << "Imported " << i << " lines" << std::endl;
-                }
+            ++stats.records;
+            bool changed;
+            merge_node(node, changed);
+            report_progress(i);
+        };
+
+        if (stream || BlockReader::detect(path) != BlockReader::CODEC_PLAIN) {
+            /* read (and decompressed) on the reader thread while we parse,
+             * streams are double buffered in big blocks. Neither can be followed */
+            BlockReader reader(stream ? 4 << 20 : 1 << 20, stream ? 2 : 4);
+            bool ok = reader.open(path);
+            while (ok) {
+                auto line = reader.next_line();
+                if (line == nullptr) break;
+                import_line(line);
             }
-            else if (i > 100000) {
-                if (i % 100000 == 0) {
-                    std::cout << "Imported " << i << " lines" << std::endl;
-                }
+            if (!reader.error().empty()) {
+                std::cout << "Failed to read '" << path << "': " << reader.error() << std::endl;
+                return false;
             }
-            else if (i > 10000) {
-                if (i % 10000 == 0) {
-                    std::cout << "Imported " << i << " lines" << std::endl;
-                }
+            stats.lines = i;
+            std::cout << i << " nodes imported from " << reader.bytes() << " bytes of text";
+            if (reader.codec() != BlockReader::CODEC_PLAIN) {
+                std::cout << " (" << reader.compressed_bytes() << " " << BlockReader::codec_name(reader.codec()) << " bytes)";
             }
-            else if (i > 1000) {
-                if (i % 1000 == 0) {
-                    std::cout << "Imported " << i << " lines" << std::endl;
-                }
+            std::cout << "\n";
+            link_nodes();
+            return true;
+        }
+
+        std::ifstream fi(path);
+        size_t s = 1024;
+        auto buf = new char[s];
+        std::streamoff consumed = 0;
+        while (fi.good()) {
+            fi.getline(buf, s);
+            if (fi.eof()) {
+                /* no newline: when following, the producer may still be
+                 * writing it, follow() reads it once it is complete */
+                if (following || fi.gcount() == 0) break;
             }
             else {
-                if (i % 100 == 0) {
-                    std::cout << "Imported " << i << " lines" << std::endl;
-                }
+                consumed += fi.gcount();
             }
+            import_line(buf);
         }
         delete [] buf;
+        stats.lines = i;
         std::cout << i << " nodes imported\n";
+
+        /* remember where we stopped, so that follow() only reads what is appended later */
+        import_path = path;
+        import_offset = consumed;
     }
     catch (...) {
         std::cout << "input error" << std::endl;
         return false;
     }
 
+    link_nodes();
+    return true;
+}
+
+void MemoryDump::link_nodes()
+{
+    Profile::Scope scope(profile, "resolve_parents");
+    edge_policy.resolve();
+    frozen_edges.clear();
+    children_sorted = false;
+    /* in the order of the labels, not of the hash table: the order of the
+     * top nodes and of the children picks the edges closing the cycles, as
+     * in the out-of-core import */
+    for (auto node : nodes_by_label()) {
+        link_node(*node);
+    }
+}
+
+std::vector<Node*> MemoryDump::nodes_by_label()
+{
+    std::vector<Node*> ret;
+    ret.reserve(nodes.size());
     for (auto &&pair : nodes) {
-        auto &node = pair.second;
-        bool top_level = true;
+        ret.push_back(&pair.second);
+    }
+    std::sort(ret.begin(), ret.end(), [](const Node *a, const Node *b) {
+        return a->label < b->label;
+    });
+    return ret;
+}
 
-        /* find the top edge priority */
-        enum EdgePriority priority = EDGE_PRIORITY_MIN;
-        for (const auto & p : node.parents) {
-            bool skip = false;
+int MemoryDump::top_priority(const Node &node) const
+{
+    int priority = EDGE_PRIORITY_MIN;
+    for (const auto & p : node.parents) {
+        bool skip = false;
+        auto parent = nodes.find(p.label);
+        if (parent != nodes.end() && edge_policy.keep_context()) {
+            auto pname = parent->second.name.str();
+            if (pname == "self" || pname == "???") { // always keep the edges from self and ??? to its context
+                skip = true;
+            }
+        }
+        auto p_priority = edge_policy.priority(p, node);
+        if (p_priority > priority && !skip) {
+            priority = p_priority;
+        }
+    }
+    return priority;
+}
+
+size_t MemoryDump::link_node(Node &node)
+{
+    size_t linked = 0;
+    auto priority = top_priority(node);
+
+    for (auto & p : node.parents) {
+        if (edge_policy.priority(p, node) >= priority) { // only take the top priority one
             auto parent = nodes.find(p.label);
             if (parent != nodes.end()) {
-                auto pname = parent->second.name.str();
-                if (pname == "self" || pname == "???") { // always keep the edges from self and ??? to its context
-                    skip = true;
-                }
+                ++linked;
+                ChildNode c = { &node, p.edge };
+                parent->second.children.push_back(c);
             }
-            if (p.priority > priority && !skip) {
-                priority = p.priority;
+            else {
+                dangling[p.label].push_back(node.label);
+                ++stats.edges_dropped_missing;
             }
         }
+        else {
+            ++stats.edges_dropped_priority;
+        }
+    }
+    stats.edges_kept += linked;
 
-        for (auto & p : node.parents) {
-            if (p.priority >= priority) { // only take the top priority one
-                auto parent = nodes.find(p.label);
-                if (parent != nodes.end()) {
-                    top_level = false;
-                    ChildNode c = { &node, p.edge };
-                    parent->second.children.push_back(c);
-                }
+    if (linked == 0) {
+        ChildNode c = { &node, "" };
+        top_nodes.push_back(c);
+    }
+    return linked;
+}
+
+void MemoryDump::freeze_edges()
+{
+    /* every recorded parent edge, grouped by child, with the parent and the
+     * "self"/"???" test resolved once. A node without parents gets an entry
+     * with no edge, so that the top nodes keep the order import gives them */
+    frozen_edges.clear();
+    for (auto n : nodes_by_label()) {
+        auto &node = *n;
+        if (node.parents.empty()) {
+            FrozenEdge e = { &node, nullptr, nullptr, false };
+            frozen_edges.push_back(e);
+        }
+        for (const auto &p : node.parents) {
+            FrozenEdge e;
+            e.child = &node;
+            e.parent = nullptr;
+            e.edge = &p;
+            e.context = false;
+            auto parent = nodes.find(p.label);
+            if (parent != nodes.end()) {
+                e.parent = &parent->second;
+                auto pname = parent->second.name.str();
+                e.context = pname == "self" || pname == "???";
             }
+            frozen_edges.push_back(e);
         }
+    }
+}
+
+double MemoryDump::reselect_edges()
+{
+    Profile::Scope scope(profile, "reselect_edges");
+    if (frozen_edges.empty()) freeze_edges();
+    edge_policy.resolve();
+
+    top_nodes.clear();
+    dangling.clear();
+    for (auto &&pair : nodes) {
+        auto &node = pair.second;
+        node.children.clear();
+        node.subtree_size = node.size;
+        node.subtree_size_division = 0;
+        node.critical = false;
+        node.visited = -1;
+    }
 
-        if (top_level) {
-            ChildNode c = { &pair.second, "" };
+    std::vector<int> priorities;
+    for (size_t i = 0; i < frozen_edges.size();) {
+        auto child = frozen_edges[i].child;
+        size_t end = i;
+        int top = EDGE_PRIORITY_MIN;
+        priorities.clear();
+        for (; end < frozen_edges.size() && frozen_edges[end].child == child; end++) {
+            const auto &e = frozen_edges[end];
+            priorities.push_back(e.edge == nullptr ? EdgePolicy::IGNORE : edge_policy.priority(*e.edge, *child));
+            if (priorities.back() > top && !(e.context && edge_policy.keep_context())) {
+                top = priorities.back();
+            }
+        }
+        size_t linked = 0;
+        for (size_t j = i; j < end; j++) {
+            const auto &e = frozen_edges[j];
+            if (priorities[j - i] < top) continue;
+            if (e.parent != nullptr) {
+                ChildNode c = { child, e.edge->edge };
+                e.parent->children.push_back(c);
+                ++linked;
+            }
+            else {
+                dangling[e.edge->label].push_back(child->label);
+            }
+        }
+        if (linked == 0) {
+            ChildNode c = { child, "" };
             top_nodes.push_back(c);
         }
+        i = end;
     }
 
-    return true;
+    return update_subtree_size();
+}
+
+void MemoryDump::unlink_node(Node &node, std::set<Node*> &dirty)
+{
+    auto is_node = [&node](const ChildNode &c) { return c.node == &node; };
+    for (const auto & p : node.parents) {
+        auto parent = nodes.find(p.label);
+        if (parent == nodes.end()) continue;
+        auto &children = parent->second.children;
+        auto iter = std::remove_if(children.begin(), children.end(), is_node);
+        if (iter != children.end()) {
+            children.erase(iter, children.end());
+            dirty.insert(&parent->second);
+        }
+    }
+}
+
+size_t MemoryDump::follow()
+{
+    if (import_path.empty()) return 0;
+
+    std::vector<Node*> touched;
+    size_t n = 0;
+    try {
+        std::ifstream fi(import_path);
+        fi.seekg(0, std::ifstream::end);
+        std::streamoff end = fi.tellg();
+        if (end < import_offset) {
+            std::cout << "'" << import_path << "' was truncated, importing it again" << std::endl;
+            import(import_path);
+            update_subtree_size();
+            return nodes.size();
+        }
+        fi.seekg(import_offset);
+
+        std::string line;
+        while (std::getline(fi, line)) {
+            if (fi.eof()) break; /* a partial record the producer is still writing */
+            import_offset += line.size() + 1;
+            Node node;
+            auto parse_result = parse(line.c_str(), node);
+            if (parse_result == PARSE_FAIL) {
+                std::cout << "Failed to parse appended line: " << line << std::endl;
+                continue;
+            }
+            else if (parse_result == PARSE_COMMENT) {
+                continue;
+            }
+            ++n;
+            bool changed;
+            auto p = merge_node(node, changed);
+            if (changed) {
+                touched.push_back(p);
+            }
+        }
+    }
+    catch (...) {
+        std::cout << "input error" << std::endl;
+        return 0;
+    }
+
+    if (touched.empty()) return n;
+
+    /* re-select the parent edges of new and re-parented nodes, and of the
+     * nodes that were waiting for one of the new nodes to show up */
+    std::set<Node*> relink(touched.begin(), touched.end());
+    for (auto node : touched) {
+        auto iter = dangling.find(node->label);
+        if (iter == dangling.end()) continue;
+        for (auto label : iter->second) {
+            relink.insert(&nodes[label]);
+        }
+        dangling.erase(iter);
+    }
+
+    clear_critical(top_nodes);
+    edge_policy.resolve();
+    frozen_edges.clear();
+
+    std::set<Node*> dirty;
+    for (auto node : relink) {
+        unlink_node(*node, dirty);
+    }
+    top_nodes.erase(std::remove_if(top_nodes.begin(), top_nodes.end(),
+        [&relink](const ChildNode &c) {
+        return relink.find(c.node) != relink.end();
+    }
+    ), top_nodes.end());
+    for (auto node : relink) {
+        link_node(*node);
+        dirty.insert(node);
+    }
+
+    recount_divisions(relink, dirty);
+    update_subtree_size(dirty);
+    std::cout << n << " records appended, " << relink.size() << " nodes relinked, "
+        << dirty.size() << " nodes resized" << std::endl;
+    return n;
+}
+
+void MemoryDump::recount_divisions(const std::set<Node*> &relink, std::set<Node*> &dirty)
+{
+    /* only the divisions below the relinked nodes can change. They are
+     * counted again by the rule of pre_update_subtree_size(), from the top
+     * nodes above them and over their ancestors only: no other node leads
+     * to them. The nodes whose division changed are resized */
+    std::unordered_map<Node*, bool> scope; /* true below the relinked nodes */
+    std::vector<Node*> region;
+    for (auto node : relink) {
+        if (scope.insert(std::make_pair(node, true)).second) region.push_back(node);
+    }
+    for (size_t i = 0; i < region.size(); i++) {
+        for (const auto &c : region[i]->children) {
+            if (scope.insert(std::make_pair(c.node, true)).second) region.push_back(c.node);
+        }
+    }
+    std::vector<Node*> work(region);
+    while (!work.empty()) {
+        auto node = work.back();
+        work.pop_back();
+        for (const auto &p : node->parents) {
+            auto parent = nodes.find(p.label);
+            if (parent != nodes.end() && scope.insert(std::make_pair(&parent->second, false)).second) {
+                work.push_back(&parent->second);
+            }
+        }
+    }
+
+    std::vector<short> divisions;
+    divisions.reserve(region.size());
+    for (auto node : region) {
+        divisions.push_back(node->subtree_size_division);
+        node->subtree_size_division = 0;
+    }
+    for (const auto &top : top_nodes) {
+        if (scope.find(top.node) == scope.end()) continue;
+        std::set<uintptr_t> path;
+        recount_division(*top.node, scope, path);
+        clear_visited(*top.node);
+    }
+    for (size_t i = 0; i < region.size(); i++) {
+        if (region[i]->subtree_size_division != divisions[i]) {
+            dirty.insert(region[i]);
+        }
+    }
+}
+
+void MemoryDump::recount_division(Node &node, const std::unordered_map<Node*, bool> &scope, std::set<uintptr_t> &path)
+{
+    /* pre_update_subtree_size() within the scope, counting in the region */
+    if (path.find(node.label) != path.end()) return;
+    if (scope.find(&node)->second) node.subtree_size_division++;
+    if (node.visited >= 0) return;
+    node.visited = 1;
+    auto pair = path.insert(node.label);
+    for (auto c : node.children) {
+        if (scope.find(c.node) != scope.end()) {
+            recount_division(*c.node, scope, path);
+        }
+    }
+    if (pair.second) {
+        path.erase(pair.first);
+    }
 }
 
 Node *MemoryDump::find_node(std::vector<std::string> path) const
@@ -248,35 +652,184 @@ double MemoryDump::update_subtree_size(Node &node, std::set<uintptr_t> &path)
     if (node.visited >= 0) return node.subtree_size / node.subtree_size_division;
     node.visited = 1;
     auto pair = path.insert(node.label);
-    for (auto c : node.children) {
+    for (auto &c : node.children) {
+        c.loop = path.find(c.node->label) != path.end();
+        if (track_kinds && !c.loop) {
+            node.subtree_size += update_subtree_size(*c.node, path);
+            add_kinds(node, *c.node, 1.0 / c.node->subtree_size_division);
+            continue;
+        }
         node.subtree_size += update_subtree_size(*c.node, path);
     }
+    if (track_hashes) node.hash = subtree_hash(node, path);
     if (pair.second) {
         path.erase(pair.first);
     }
     return node.subtree_size / node.subtree_size_division;
 }
 
-double MemoryDump::update_subtree_size()
+double MemoryDump::update_subtree_size(bool critical)
 {
     total_size = 0;
-    for (auto node : top_nodes) {
-        std::set<uintptr_t> path;
-        pre_update_subtree_size(*node.node, path);
-        clear_visited(*node.node);
+    children_sorted = false;
+    if (track_kinds) init_kind_rows();
+    {
+        Profile::Scope scope(profile, "pre_update_subtree_size");
+        for (auto node : top_nodes) {
+            std::set<uintptr_t> path;
+            pre_update_subtree_size(*node.node, path);
+            clear_visited(*node.node);
+        }
     }
 
-    for (auto node : top_nodes) {
-        std::set<uintptr_t> path;
-        total_size += update_subtree_size(*node.node, path);
+    {
+        Profile::Scope scope(profile, "update_subtree_size");
+        for (auto node : top_nodes) {
+            std::set<uintptr_t> path;
+            total_size += update_subtree_size(*node.node, path);
+        }
+        clear_visited();
+    }
+
+    if (critical) {
+        update_critical();
     }
+    return total_size;
+}
+
+namespace {
+    /* what the child adds to the subtree_size of the node */
+    double child_share(const ChildNode &c)
+    {
+        if (c.loop) return 0;
+        return c.node->subtree_size / std::max<short>(c.node->subtree_size_division, 1);
+    }
+
+    uint64_t mix(uint64_t h)
+    {
+        /* splitmix64 finalizer */
+        h ^= h >> 30;
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 27;
+        h *= 0x94d049bb133111ebULL;
+        return h ^ (h >> 31);
+    }
+}
+
+uint64_t MemoryDump::subtree_hash(const Node &node, const std::set<uintptr_t> &path) const
+{
+    /* the children are hashed in any order, a child still on the path
+     * closes a loop and counts for its edge only */
+    const uint64_t loop = 0x9e3779b97f4a7c15ULL;
+    std::vector<uint64_t> children;
+    children.reserve(node.children.size());
+    for (const auto &c : node.children) {
+        uint64_t h = path.find(c.node->label) != path.end() ? loop : c.node->hash;
+        children.push_back(mix(h + mix(static_cast<uint64_t>(c.edge.index()) + 1)));
+    }
+    std::sort(children.begin(), children.end());
+    uint64_t h = mix(static_cast<uint64_t>(node.node_type) + 1);
+    h = mix(h ^ node.size);
+    h = mix(h ^ static_cast<uint64_t>(node.name.index() + 1));
+    for (auto c : children) {
+        h = mix(h ^ c);
+    }
+    return h;
+}
+
+void MemoryDump::dedup_children(std::vector<ChildNode*> &edges, std::vector<size_t> &copies)
+{
+    /* keeps the first (biggest) of each set of siblings with the same hash */
+    std::unordered_map<uint64_t, size_t> first;
+    size_t n = 0;
+    copies.clear();
+    for (auto c : edges) {
+        auto iter = first.find(c->node->hash);
+        if (iter != first.end() && c->node->visited < 0) {
+            ++copies[iter->second];
+            ++stats.subtrees_deduplicated;
+            continue;
+        }
+        first.insert(std::make_pair(c->node->hash, n));
+        edges[n++] = c;
+        copies.push_back(1);
+    }
+    edges.resize(n);
+}
+
+void MemoryDump::update_critical()
+{
+    Profile::Scope scope(profile, "set_critical");
+    set_critical(top_nodes);
     clear_visited();
+}
+
+double MemoryDump::resize_node(Node &node, const std::set<Node*> &dirty, std::set<uintptr_t> &path)
+{
+    /* update_subtree_size() over the dirty nodes: the others, never on a
+     * path through them, keep their size */
+    if (path.find(node.label) != path.end()) return 0;
+    if (node.visited >= 0 || dirty.find(&node) == dirty.end()) {
+        return node.subtree_size / node.subtree_size_division;
+    }
+    node.visited = 1;
+    auto pair = path.insert(node.label);
+    node.subtree_size = node.size;
+    if (track_kinds) reset_kind_row(node);
+    for (auto &c : node.children) {
+        c.loop = path.find(c.node->label) != path.end();
+        if (c.loop) continue;
+        node.subtree_size += resize_node(*c.node, dirty, path);
+        if (track_kinds) add_kinds(node, *c.node, 1.0 / c.node->subtree_size_division);
+    }
+    if (track_hashes) node.hash = subtree_hash(node, path);
+    if (pair.second) {
+        path.erase(pair.first);
+    }
+    return node.subtree_size / node.subtree_size_division;
+}
+
+double MemoryDump::update_subtree_size(std::set<Node*> &dirty)
+{
+    Profile::Scope scope(profile, "update_subtree_size");
+    children_sorted = false;
+    /* everything above a changed node has to be resized as well */
+    std::vector<Node*> work(dirty.begin(), dirty.end());
+    while (!work.empty()) {
+        auto node = work.back();
+        work.pop_back();
+        for (const auto & p : node->parents) {
+            auto parent = nodes.find(p.label);
+            if (parent != nodes.end() && dirty.insert(&parent->second).second) {
+                work.push_back(&parent->second);
+            }
+        }
+    }
+
+    /* in the order of the full sizing, for the same edges to close the cycles */
+    total_size = 0;
+    for (const auto & node : top_nodes) {
+        std::set<uintptr_t> path;
+        total_size += resize_node(*node.node, dirty, path);
+    }
+    for (auto node : dirty) {
+        node->visited = -1;
+    }
 
     set_critical(top_nodes);
     clear_visited();
     return total_size;
 }
 
+void MemoryDump::clear_critical(const std::vector<ChildNode> &nodes)
+{
+    for (const auto & node : nodes) {
+        if (!node.node->critical) continue;
+        node.node->critical = false;
+        clear_critical(node.node->children);
+    }
+}
+
 void MemoryDump::clear_visited(Node &node)
 {
     if (node.visited < 0) return;
@@ -319,126 +872,920 @@ bool MemoryDump::draw_tree(Node &node, std::ofstream &ofile, const cmd_opt &opt,
     node.visited = level;
 
     std::vector<ChildNode*> edges;
-    for (auto &&c : node.children) {
-        if (c.node->subtree_size >= min_size
-            && (!opt.critical_only || c.node->critical)) {
-            edges.push_back(&c);
-        }
-    }
-    
-    std::sort(edges.begin(), edges.end(),
-        [](const ChildNode *a, const ChildNode *b) {
-        return a->node->subtree_size > b->node->subtree_size;
-    }
-    );
-
-    if (opt.max_subnodes > 0 && edges.size() > opt.max_subnodes) { //too many nodes, only write nodes with big sizes;
-        edges.resize(opt.max_subnodes);
+    select_children(node, opt, edges);
+    std::vector<size_t> copies;
+    /* the others are the children select_children() left out, not the
+     * siblings drawn through an identical representative */
+    std::vector<ChildNode*> selection;
+    if (opt.dedup && track_hashes) {
+        if (opt.coarsen) selection = edges;
+        dedup_children(edges, copies);
     }
+    const auto &selected = selection.empty() ? edges : selection;
 
     bool tail_written = false;
-    for (const auto & c : edges) {
+    for (size_t i = 0; i < edges.size(); i++) {
+        const auto c = edges[i];
+        size_t n = copies.empty() ? 1 : copies[i];
         if (!tail_written && declared_nodes.find(node.label) == declared_nodes.end()) {
             write_node(node, ofile, opt);
             declared_nodes.insert(node.label);
             tail_written = true;
         }
+        if (opt.coarsen && n == 1 && write_chain(node, *c, ofile, opt, declared_nodes, level)) {
+            continue;
+        }
         if (declared_nodes.find(c->node->label) == declared_nodes.end()) {
             write_node(*c->node, ofile, opt);
             declared_nodes.insert(c->node->label);
         }
-        exporter->write_edge(node, *c->node, ofile, c->edge.str());
+        /* the representative of n identical subtrees */
+        auto edge = c->edge.str();
+        if (n > 1) edge += (edge.empty() ? "x" : " x") + std::to_string(n);
+        write_edge(node, *c->node, ofile, edge);
         draw_tree(*c->node, ofile, opt, declared_nodes, level + 1);
     }
 
+    if (opt.coarsen && selected.size() < node.children.size()) {
+        if (declared_nodes.find(node.label) == declared_nodes.end()) {
+            write_node(node, ofile, opt);
+            declared_nodes.insert(node.label);
+        }
+        write_others(node, selected, ofile, opt);
+    }
+
     return true;
 }
 
-void MemoryDump::write_node(const Node &node, std::ofstream &ofile, const cmd_opt &opt)
+Node *MemoryDump::coarse_node(const std::string &name, double size, enum Reb_Kind kind)
 {
-    exporter->write_node(node, ofile, opt);
+    /* odd labels, real ones are aligned */
+    coarse_nodes.push_back(Node(2 * coarse_nodes.size() + 1, name));
+    auto &n = coarse_nodes.back();
+    n.size = static_cast<uint32_t>(std::min<double>(size, UINT32_MAX));
+    n.subtree_size = size;
+    n.node_type = kind;
+    n.subtree_size_division = 1;
+    return &n;
 }
 
-bool MemoryDump::write_output(const cmd_opt &opt)
+bool MemoryDump::write_chain(Node &node, ChildNode &c, std::ofstream &ofile, const cmd_opt &opt, std::set<uintptr_t> &declared_nodes, int level)
 {
-    try {
-        std::ofstream ofile(opt.ofile, std::ofstream::trunc);
-        min_size = total_size * opt.threshold;
-        if (exporter == nullptr
-            || export_type != opt.export_type) {
-            delete exporter;
-            export_type = opt.export_type;
-            switch (export_type) {
-            case EXPORT_DOT:
-                exporter = new ExporterDot(total_size);
-                break;
-            case EXPORT_GML:
-                exporter = new ExporterGML(total_size);
-                break;
-            case EXPORT_GRAPHML:
-                exporter = new ExporterGraphML();
-                break;
-            default:
-                exporter = new ExporterDot(total_size);
-                export_type = EXPORT_DOT;
+    /* a chain is a run of nodes with a single parent and a single child,
+     * none of them written yet */
+    std::vector<Node*> chain;
+    Node *x = c.node;
+    while (x->visited < 0
+        && x->subtree_size_division == 1
+        && x->children.size() == 1
+        && declared_nodes.find(x->label) == declared_nodes.end()) {
+        const auto &next = x->children.front();
+        if (next.node->visited >= 0 || next.node->subtree_size < min_size
+            || (opt.critical_only && !next.node->critical)) {
+            break;
+        }
+        x->visited = level + 1;
+        chain.push_back(x);
+        x = next.node;
+    }
+    if (chain.size() < 2) {
+        for (auto n : chain) n->visited = -1;
+        return false;
+    }
+
+    double size = 0;
+    for (auto n : chain) size += n->size;
+    std::string name = "chain of " + std::to_string(chain.size()) + ": "
+        + chain.front()->name.str() + " .. " + chain.back()->name.str();
+    Node *s = coarse_node(name, size, chain.front()->node_type);
+    s->subtree_size = chain.front()->subtree_size;
+    s->critical = chain.front()->critical;
+    write_node(*s, ofile, opt);
+    write_edge(node, *s, ofile, c.edge.str());
+    if (declared_nodes.find(x->label) == declared_nodes.end()) {
+        write_node(*x, ofile, opt);
+        declared_nodes.insert(x->label);
+    }
+    write_edge(*s, *x, ofile, chain.back()->children.front().edge.str());
+    draw_tree(*x, ofile, opt, declared_nodes, level + 1);
+    return true;
+}
+
+void MemoryDump::write_others(Node &node, const std::vector<ChildNode*> &edges, std::ofstream &ofile, const cmd_opt &opt)
+{
+    /* kind => count, bytes. -1 mixes the kinds: all of them unless grouped,
+     * otherwise those that would not pass the threshold on their own */
+    const int mixed = -1;
+    std::map<int, std::pair<size_t, double>> groups;
+    std::vector<bool> written(node.children.size(), false);
+    if (!opt.others_by_kind && is_prefix(node, edges)) {
+        groups[mixed] = std::make_pair(node.children.size() - edges.size(), hidden_size(node, edges.size()));
+        written.assign(node.children.size(), true);
+    }
+    for (auto c : edges) {
+        written[c - &node.children.front()] = true;
+    }
+    for (size_t i = 0; i < node.children.size(); i++) {
+        if (written[i]) continue;
+        const auto &c = node.children[i];
+        auto &g = groups[opt.others_by_kind ? c.node->node_type : mixed];
+        g.first++;
+        g.second += child_share(c);
+    }
+    if (opt.others_by_kind) {
+        std::pair<size_t, double> small(0, 0);
+        for (auto g = groups.begin(); g != groups.end();) {
+            if (g->second.second < min_size) {
+                small.first += g->second.first;
+                small.second += g->second.second;
+                g = groups.erase(g);
+            }
+            else {
+                ++g;
             }
         }
+        if (small.first > 0) groups[mixed] = small;
+    }
+    for (const auto &g : groups) {
+        std::string name = std::to_string(g.second.first) + " ";
+        if (g.first != mixed) {
+            name += std::string(kind_name(g.first)) + " ";
+        }
+        name += "others (" + std::to_string(std::llround(g.second.second)) + " bytes)";
+        Node *s = coarse_node(name, g.second.second, g.first == mixed ? REB_TRASH : static_cast<enum Reb_Kind>(g.first));
+        write_node(*s, ofile, opt);
+        write_edge(node, *s, ofile, "<others>");
+    }
+}
+
+void MemoryDump::select_children(Node &node, const cmd_opt &opt, std::vector<ChildNode*> &edges)
+{
+    if (children_sorted && !opt.critical_only) {
+        /* a prefix, found without looking at the children left out */
+        auto n = visible_children(node, min_size, opt.max_subnodes);
+        edges.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            edges.push_back(&node.children[i]);
+        }
+        return;
+    }
+
+    for (auto &&c : node.children) {
+        if (c.node->subtree_size >= min_size
+            && (!opt.critical_only || c.node->critical)) {
+            edges.push_back(&c);
+        }
+    }
+    
+    if (!children_sorted) {
+        Profile::Scope scope(profile, "sort", true);
+        std::sort(edges.begin(), edges.end(),
+            [](const ChildNode *a, const ChildNode *b) {
+            return a->node->subtree_size > b->node->subtree_size;
+        }
+        );
+    }
+
+    if (opt.max_subnodes > 0 && edges.size() > static_cast<size_t>(opt.max_subnodes)) { //too many nodes, only write nodes with big sizes;
+        edges.resize(opt.max_subnodes);
+    }
+}
+
+double MemoryDump::written_below(Node &node, std::unordered_map<Node*, double> &excess)
+{
+    /* the part of node's subtree_size that is the share of written nodes,
+     * reached through nodes not written. Only the nodes in `excess' lead to
+     * any, like the sizing a loop adds nothing */
+    auto iter = excess.find(&node);
+    if (iter == excess.end()) return 0;
+    if (iter->second >= 0) return iter->second;
+    iter->second = 0;
+    double size = 0;
+    for (const auto &c : node.children) {
+        if (c.loop) continue;
+        auto division = std::max<short>(c.node->subtree_size_division, 1);
+        size += (c.node->visited == 0 ? c.node->subtree_size : written_below(*c.node, excess)) / division;
+    }
+    iter->second = size;
+    return size;
+}
+
+void MemoryDump::write_tree(const std::vector<Node*> &roots, std::ofstream &ofile, const cmd_opt &opt)
+{
+    ExporterFolded folded;
+    ExporterJSON json(this);
+    TreeExporter *tree = &folded;
+    if (opt.tree_export == TREE_EXPORT_JSON) {
+        tree = &json;
+    }
+
+    /* the first walk picks the nodes to write and the edges they are written
+     * with, the second writes them in the same order. Iterative, so that the
+     * stack is bounded by the depth. visited is 1 while a node is on the
+     * stack and 0 once it is picked */
+    struct Pick {
+        Node *node;
+        size_t first; /* its edges in `picked' */
+        size_t last;
+        double self; /* its size and what it leaves out */
+    };
+    std::vector<Pick> order;
+    std::vector<ChildNode*> picked;
+    std::vector<ChildNode*> edges;
+    std::vector<std::pair<size_t, size_t>> path; /* into order and picked */
+    auto pick = [&](Node &node) {
+        node.visited = 1;
+        path.push_back(std::make_pair(order.size(), picked.size()));
+        edges.clear();
+        if ((opt.depth <= 0 || path.size() <= static_cast<size_t>(opt.depth))
+            && (!opt.critical_only || node.critical)) {
+            select_children(node, opt, edges);
+        }
+        /* what is not written is accounted to the node itself */
+        Pick p = { &node, picked.size(), picked.size() + edges.size(), static_cast<double>(node.size) };
+        if (is_prefix(node, edges)) {
+            p.self += hidden_size(node, edges.size());
+        }
         else {
-            switch (export_type) {
-            case EXPORT_DOT:
-            case EXPORT_GML:
-                exporter->set_total_size(total_size);
-                break;
-            default:
-                break;
+            std::vector<bool> written(node.children.size(), false);
+            for (auto c : edges) {
+                written[c - &node.children.front()] = true;
+            }
+            for (size_t i = node.children.size(); i-- > 0;) {
+                if (!written[i]) p.self += child_share(node.children[i]);
             }
         }
-        exporter->write_preamble(ofile);
-        std::vector<Node*> selected_nodes;
-        if (opt.nodes.empty() && opt.labels.empty()) {
-            for (const auto &c : top_nodes) {
-                selected_nodes.push_back(c.node);
+        order.push_back(p);
+        picked.insert(picked.end(), edges.begin(), edges.end());
+    };
+    for (auto root : roots) {
+        if (root->visited >= 0) continue;
+        pick(*root);
+        while (!path.empty()) {
+            auto &top = path.back();
+            if (top.second < order[top.first].last) {
+                auto c = picked[top.second++];
+                if (c->node->visited < 0) pick(*c->node);
+            }
+            else {
+                order[top.first].node->visited = 0;
+                path.pop_back();
             }
         }
-        else {
-            /* find the node pointed by opt.node */
-            for (const auto &path : opt.nodes) {
-                auto node = find_node(path.node);
-                if (node == nullptr) {
-                    std::cout << "No node found for path " << path.literal << std::endl;
-                    continue;
-                }
-                selected_nodes.push_back(node);
+    }
+
+    /* the share of a child written elsewhere is charged back in full, and
+     * that of one not written for the written nodes below it, so that nothing
+     * is counted twice. Only a root or a node with more than one parent can
+     * be written elsewhere, the nodes leading to those are found going up
+     * from them */
+    std::unordered_map<Node*, double> excess; /* not written, above a written node */
+    std::unordered_set<Node*> charged; /* written, above a node written elsewhere */
+    std::vector<Node*> work(roots.begin(), roots.end());
+    for (const auto &p : order) {
+        if (p.node->parents.size() > 1) work.push_back(p.node);
+    }
+    while (!work.empty()) {
+        auto node = work.back();
+        work.pop_back();
+        auto priority = top_priority(*node);
+        for (const auto &p : node->parents) {
+            if (edge_policy.priority(p, *node) < priority) continue; /* not linked, see link_node() */
+            auto parent = nodes.find(p.label);
+            if (parent == nodes.end()) continue;
+            auto pnode = &parent->second;
+            if (pnode->visited == 0) {
+                charged.insert(pnode);
+            }
+            else if (excess.insert(std::make_pair(pnode, -1.0)).second) {
+                work.push_back(pnode);
+            }
+        }
+    }
+    if (!charged.empty()) {
+        for (auto &p : order) {
+            if (charged.find(p.node) == charged.end()) continue;
+            auto &children = p.node->children;
+            std::vector<bool> written(children.size(), false);
+            for (auto i = p.first; i < p.last; i++) {
+                written[picked[i] - &children.front()] = true;
             }
+            for (size_t i = 0; i < children.size(); i++) {
+                const auto &c = children[i];
+                if (written[i] || c.loop) continue;
+                auto division = std::max<short>(c.node->subtree_size_division, 1);
+                p.self -= (c.node->visited == 0 ? c.node->subtree_size : written_below(*c.node, excess)) / division;
+            }
+        }
+    }
+
+    /* the second walk writes them, visited goes from 0 to 1 while a node is
+     * on the stack and 2 once it is written */
+    struct Frame {
+        size_t pick;
+        size_t next;
+        double total;
+    };
+    std::vector<Frame> stack;
+    size_t next_pick = 0;
+    auto push = [&](const std::string &edge) {
+        auto &p = order[next_pick];
+        tree->enter(*p.node, edge, ofile);
+        ++stats.nodes_written;
+        p.node->visited = 1;
+        Frame f = { next_pick++, p.first, 0 };
+        stack.push_back(f);
+    };
 
-            for (const auto &label : opt.labels) {
-                auto node = nodes.find(label);
-                if (node != nodes.end()) {
-                    std::cout << "Found node by label " << std::hex << label << std::dec << std::endl;
-                    selected_nodes.push_back(&node->second);
+    double total = 0;
+    tree->write_preamble(ofile);
+    for (auto root : roots) {
+        if (root->visited != 0) continue;
+        push("");
+        while (!stack.empty()) {
+            auto &f = stack.back();
+            const auto &p = order[f.pick];
+            if (f.next < p.last) {
+                auto c = picked[f.next++];
+                if (c->node->visited != 0) continue; /* written already, or a back edge */
+                ++stats.edges_written;
+                push(c->edge.str());
+            }
+            else {
+                f.total += p.self;
+                tree->leave(*p.node, p.self, f.total, ofile);
+                p.node->visited = 2;
+                auto t = f.total;
+                stack.pop_back();
+                if (stack.empty()) {
+                    total += t;
                 }
                 else {
-                    std::cout << "Label " << std::hex << label << std::dec << " was not found\n";
+                    stack.back().total += t;
                 }
             }
         }
-        std::set<uintptr_t> declared_nodes;
-        for (auto & node : selected_nodes) {
-            write_node(*node, ofile, opt);
-            declared_nodes.insert(node->label);
-            draw_tree(*node, ofile, opt, declared_nodes);
+    }
+    tree->write_appendix(total, ofile);
+
+    for (auto root : roots) {
+        clear_visited(*root);
+    }
+}
+
+void MemoryDump::write_node(const Node &node, std::ofstream &ofile, const cmd_opt &opt)
+{
+    Profile::Scope scope(profile, "exporter_io", true);
+    if (columns != nullptr) {
+        auto name = node.name.str();
+        columns->label.push_back(node.label);
+        columns->subtree_size.push_back(node.subtree_size);
+        columns->kind.push_back(node.node_type);
+        columns->size.push_back(node.size);
+        columns->name.push_back(name.empty() ? ColumnTables::NO_STRING : columns->intern(name));
+        columns->critical.push_back(node.critical);
+    }
+    else {
+        exporter->write_node(node, ofile, opt);
+    }
+    ++stats.nodes_written;
+}
+
+void MemoryDump::write_edge(const Node &from, const Node &to, std::ofstream &ofile, const std::string &edge)
+{
+    Profile::Scope scope(profile, "exporter_io", true);
+    if (columns != nullptr) {
+        columns->parent.push_back(from.label);
+        columns->child.push_back(to.label);
+        columns->edge.push_back(edge.empty() ? ColumnTables::NO_STRING : columns->intern(edge));
+    }
+    else {
+        exporter->write_edge(from, to, ofile, edge);
+    }
+    ++stats.edges_written;
+}
+
+std::vector<Node*> MemoryDump::select_nodes(const cmd_opt &opt)
+{
+    std::vector<Node*> selected_nodes;
+    if (opt.nodes.empty() && opt.labels.empty() && opt.filter.empty()) {
+        for (const auto &c : top_nodes) {
+            selected_nodes.push_back(c.node);
+        }
+    }
+    else {
+        /* find the node pointed by opt.node */
+        for (const auto &path : opt.nodes) {
+            auto node = find_node(path.node);
+            if (node == nullptr) {
+                std::cout << "No node found for path " << path.literal << std::endl;
+                continue;
+            }
+            selected_nodes.push_back(node);
+        }
+
+        for (const auto &label : opt.labels) {
+            auto node = nodes.find(label);
+            if (node != nodes.end()) {
+                std::cout << "Found node by label " << std::hex << label << std::dec << std::endl;
+                selected_nodes.push_back(&node->second);
+            }
+            else {
+                std::cout << "Label " << std::hex << label << std::dec << " was not found\n";
+            }
+        }
+
+        if (!opt.filter.empty()) {
+            NodeFilter filter;
+            if (filter.parse(opt.filter)) {
+                auto matches = filter.select(*this);
+                selected_nodes.insert(selected_nodes.end(), matches.begin(), matches.end());
+            }
+            else {
+                std::cout << "Invalid filter: " << filter.parse_error() << std::endl;
+            }
+        }
+    }
+    return selected_nodes;
+}
+
+void MemoryDump::make_exporter(const cmd_opt &opt)
+{
+    if (exporter == nullptr
+        || export_type != opt.export_type) {
+        delete exporter;
+        export_type = opt.export_type;
+        switch (export_type) {
+        case EXPORT_DOT:
+            exporter = new ExporterDot(total_size);
+            break;
+        case EXPORT_GML:
+            exporter = new ExporterGML(total_size);
+            break;
+        case EXPORT_GRAPHML:
+            exporter = new ExporterGraphML();
+            break;
+        default:
+            exporter = new ExporterDot(total_size);
+            export_type = EXPORT_DOT;
+        }
+    }
+    else {
+        switch (export_type) {
+        case EXPORT_DOT:
+        case EXPORT_GML:
+            exporter->set_total_size(total_size);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+bool MemoryDump::write_graph(std::ofstream &ofile, const cmd_opt &opt)
+{
+    min_size = total_size * opt.threshold;
+    if (opt.top > 0) {
+        make_exporter(opt);
+        write_paths(top_paths(opt.top), ofile, opt);
+        return true;
+    }
+    auto selected_nodes = select_nodes(opt);
+    if (!opt.group_by.empty()) {
+        Profile::Scope scope(profile, "group_by");
+        GroupBy groups;
+        if (!groups.parse(opt.group_by)) return false;
+        groups.run(*this, selected_nodes);
+        if (!opt.group_report.empty()) groups.write_report(opt.group_report, total_size);
+        groups.write_graph(*this, ofile, opt);
+        return true;
+    }
+    if (opt.why > 0) {
+        std::vector<GraphPath> paths;
+        if (opt.nodes.empty() && opt.labels.empty() && opt.filter.empty()) {
+            std::cout << "--why needs the nodes to explain, with -l, -n or --filter" << std::endl;
+            selected_nodes.clear();
         }
-        for (auto & node : selected_nodes) {
-            clear_visited(*node);
+        for (auto node : selected_nodes) {
+            auto p = retention_paths(*node, opt.why);
+            paths.insert(paths.end(), p.begin(), p.end());
         }
+        make_exporter(opt);
+        write_paths(paths, ofile, opt);
+        return true;
+    }
+    if (opt.tree_export != TREE_EXPORT_NONE) {
+        write_tree(selected_nodes, ofile, opt);
+        return true;
+    }
+
+    ColumnTables tables;
+    if (opt.columns_export) {
+        columns = &tables;
+    }
+    else {
+        make_exporter(opt);
+        exporter->write_preamble(ofile);
+    }
+    std::set<uintptr_t> declared_nodes;
+    for (auto & node : selected_nodes) {
+        write_node(*node, ofile, opt);
+        declared_nodes.insert(node->label);
+        draw_tree(*node, ofile, opt, declared_nodes);
+    }
+    for (auto & node : selected_nodes) {
+        clear_visited(*node);
+    }
 
+    bool ok = true;
+    if (columns != nullptr) {
+        columns = nullptr;
+        ok = write_columns(tables, ofile, opt);
+    }
+    else {
         exporter->write_appendix(ofile);
+    }
+    coarse_nodes.clear();
+    return ok;
+}
 
+bool MemoryDump::write_columns(const ColumnTables &tables, std::ofstream &ofile, const cmd_opt &opt)
+{
+    /* the tables go next to the -o file, which describes them */
+    std::string error;
+    if (!tables.write(opt.ofile, error)) {
+        std::cout << "Failed to write the columns: " << error << std::endl;
+        return false;
+    }
+    auto file = opt.ofile.substr(opt.ofile.find_last_of("/\\") + 1);
+    ofile << "{\n  \"version\": " << ColumnTables::COLUMNS_VERSION
+        << ",\n  \"nodes\": {\"file\": ";
+    write_json_string(file + ".nodes", ofile);
+    ofile << ", \"rows\": " << tables.node_count()
+        << ", \"columns\": [[\"label\", \"u64\"], [\"subtree_size\", \"f64\"], [\"kind\", \"u32\"], [\"size\", \"u32\"], [\"name\", \"u32\"], [\"critical\", \"u8\"]]}"
+        << ",\n  \"edges\": {\"file\": ";
+    write_json_string(file + ".edges", ofile);
+    ofile << ", \"rows\": " << tables.edge_count()
+        << ", \"columns\": [[\"parent\", \"u64\"], [\"child\", \"u64\"], [\"edge\", \"u32\"]]}"
+        << ",\n  \"strings\": {\"file\": ";
+    write_json_string(file + ".strings", ofile);
+    ofile << ", \"rows\": " << tables.strings.size()
+        << ", \"columns\": [[\"offset\", \"u64\"]]}"
+        << ",\n  \"header_bytes\": " << sizeof(ColumnTables::ColumnHeader)
+        << ", \"no_string\": " << ColumnTables::NO_STRING << "\n}\n";
+    std::cout << tables.node_count() << " nodes, " << tables.edge_count() << " edges and "
+        << tables.strings.size() << " strings written to " << opt.ofile << ".{nodes,edges,strings}" << std::endl;
+    return true;
+}
+
+bool MemoryDump::write_output(const cmd_opt &opt)
+{
+    Profile::Scope scope(profile, "export");
+    auto start = std::chrono::steady_clock::now();
+
+    /* the exporters format into `ofile', the writer thread compresses and writes */
+    BlockReader::Codec codec;
+    int level;
+    if (!AsyncWriter::parse_codec(opt.compress, opt.ofile, codec, level)) {
+        std::cout << "Unknown output compression '" << opt.compress << "'" << std::endl;
+        return false;
+    }
+    AsyncWriter writer;
+    if (!writer.open(opt.ofile, codec, level)) {
+        std::cout << "Failed to write '" << opt.ofile << "': " << writer.error() << std::endl;
+        return false;
+    }
+    std::ofstream ofile;
+    static_cast<std::ostream&>(ofile).rdbuf(&writer);
+    bool ok = true;
+    try {
+        ok = write_graph(ofile, opt);
     }
     catch (...) {
         std::cout << "Unexpected error hanppend while writing output" << std::endl;
+        ok = false;
+    }
+    if (!writer.close()) {
+        std::cout << "Failed to write '" << opt.ofile << "': " << writer.error() << std::endl;
+        return false;
     }
 
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << writer.bytes() << " bytes";
+    if (writer.codec() != BlockReader::CODEC_PLAIN) {
+        std::cout << " (" << writer.compressed_bytes() << " " << BlockReader::codec_name(writer.codec()) << " bytes)";
+    }
+    std::cout << " exported to '" << opt.ofile << "' in " << elapsed.count() << " seconds, "
+        << writer.write_seconds() << " of them spent writing in the background" << std::endl;
+    if (profile != nullptr) {
+        profile->count("output_bytes", writer.bytes());
+        profile->count("output_file_bytes", writer.compressed_bytes());
+    }
+    return ok;
+}
+
+void MemoryDump::report_profile() const
+{
+    if (profile == nullptr) return;
+
+    profile->count("lines", stats.lines);
+    profile->count("records", stats.records);
+    profile->count("parse_failures", stats.parse_failures);
+    profile->count("duplicate_records", stats.duplicates);
+    profile->count("nodes", nodes.size());
+    profile->count("top_nodes", top_nodes.size());
+    profile->count("edges_kept", stats.edges_kept);
+    profile->count("edges_dropped_priority", stats.edges_dropped_priority);
+    profile->count("edges_dropped_missing_parent", stats.edges_dropped_missing);
+    profile->count("nodes_written", stats.nodes_written);
+    profile->count("edges_written", stats.edges_written);
+    profile->count("subtrees_deduplicated", stats.subtrees_deduplicated);
+
+    /* estimates: the containers' own overhead is approximated by a couple of
+     * pointers per element, which is what libstdc++ uses */
+    uint64_t parents = 0, children = 0;
+    for (const auto &pair : nodes) {
+        parents += pair.second.parents.size();
+        children += pair.second.children.capacity();
+    }
+    const uint64_t tree_node = 4 * sizeof(void*);
+    const uint64_t hash_node = 2 * sizeof(void*);
+    profile->set_memory("nodes", nodes.size() * (sizeof(Node) + sizeof(uintptr_t) + hash_node)
+        + nodes.bucket_count() * sizeof(void*));
+    profile->set_memory("parents", parents * (sizeof(ParentNode) + tree_node));
+    profile->set_memory("children", children * sizeof(ChildNode));
+    profile->set_memory("kind_rows", kind_rows.capacity() * sizeof(float));
+    uint64_t strings = 0;
+    for (const auto &s : StringBin::array) {
+        strings += sizeof(std::string) + s.capacity();
+    }
+    profile->set_memory("strings", 2 * strings
+        + StringBin::set.size() * (sizeof(std::pair<int, int>) + hash_node));
+}
+
+void MemoryDump::build_levels()
+{
+    Profile::Scope scope(profile, "build_levels");
+    size_t rows = 0;
+    for (const auto &pair : nodes) {
+        rows += pair.second.children.size() + 1;
+    }
+    hidden_sizes.clear();
+    bool indexed = rows < NO_LEVEL_ROW;
+    if (indexed) hidden_sizes.reserve(rows);
+    for (auto &&pair : nodes) {
+        auto &node = pair.second;
+        auto &children = node.children;
+        std::stable_sort(children.begin(), children.end(),
+            [](const ChildNode &a, const ChildNode &b) {
+            return a.node->subtree_size > b.node->subtree_size;
+        }
+        );
+        if (!indexed) {
+            node.level_row = NO_LEVEL_ROW;
+            continue;
+        }
+        node.level_row = static_cast<uint32_t>(hidden_sizes.size());
+        hidden_sizes.resize(hidden_sizes.size() + children.size() + 1);
+        double *hidden = &hidden_sizes[node.level_row];
+        hidden[children.size()] = 0;
+        for (size_t i = children.size(); i-- > 0;) {
+            hidden[i] = hidden[i + 1] + child_share(children[i]);
+        }
+    }
+    children_sorted = true;
+    if (profile != nullptr) profile->set_memory("levels", hidden_sizes.capacity() * sizeof(double));
+}
+
+size_t MemoryDump::visible_children(const Node &node, double min_size, int max_subnodes) const
+{
+    /* the children are sorted, those big enough come first */
+    auto end = std::partition_point(node.children.begin(), node.children.end(),
+        [min_size](const ChildNode &c) {
+        return c.node->subtree_size >= min_size;
+    }
+    );
+    size_t n = end - node.children.begin();
+    if (max_subnodes > 0 && n > static_cast<size_t>(max_subnodes)) n = max_subnodes;
+    return n;
+}
+
+double MemoryDump::hidden_size(const Node &node, size_t first) const
+{
+    if (children_sorted && node.level_row != NO_LEVEL_ROW) {
+        return hidden_sizes[node.level_row + first];
+    }
+    double size = 0;
+    for (size_t i = first; i < node.children.size(); i++) {
+        size += child_share(node.children[i]);
+    }
+    return size;
+}
+
+bool MemoryDump::is_prefix(const Node &node, const std::vector<ChildNode*> &edges) const
+{
+    /* edges come in the order of the children, without repeats */
+    return children_sorted
+        && (edges.empty() || edges.back() == &node.children[edges.size() - 1]);
+}
+
+void MemoryDump::init_kind_rows()
+{
+    kind_column.assign(KIND_SLOT_COUNT, -1);
+    column_kind.clear();
+    for (const auto &pair : nodes) {
+        int slot = kind_slot(pair.second.node_type);
+        if (slot >= 0 && kind_column[slot] < 0) {
+            kind_column[slot] = static_cast<int>(column_kind.size());
+            column_kind.push_back(pair.second.node_type);
+        }
+    }
+    column_kind.push_back(-1);
+
+    kind_rows.clear();
+    kind_rows.reserve(nodes.size() * column_kind.size());
+    for (auto &&pair : nodes) {
+        pair.second.kind_row = NO_KIND_ROW;
+        reset_kind_row(pair.second);
+    }
+}
+
+size_t MemoryDump::kind_row(Node &node)
+{
+    const size_t width = column_kind.size();
+    if (node.kind_row == NO_KIND_ROW) {
+        node.kind_row = static_cast<uint32_t>(kind_rows.size() / width);
+        kind_rows.resize(kind_rows.size() + width);
+    }
+    return node.kind_row * width;
+}
+
+void MemoryDump::reset_kind_row(Node &node)
+{
+    auto row = kind_row(node);
+    std::fill(kind_rows.begin() + row, kind_rows.begin() + row + column_kind.size(), 0.0f);
+    int slot = kind_slot(node.node_type);
+    int column = slot < 0 || kind_column[slot] < 0 ? column_kind.size() - 1 : kind_column[slot];
+    kind_rows[row + column] = node.size;
+}
+
+void MemoryDump::add_kinds(Node &to, Node &from, double scale)
+{
+    auto src = kind_row(from);
+    auto dst = kind_row(to);
+    for (size_t i = 0; i < column_kind.size(); i++) {
+        kind_rows[dst + i] += static_cast<float>(kind_rows[src + i] * scale);
+    }
+}
+
+bool MemoryDump::kind_breakdown(const Node &node, std::vector<std::pair<int, double>> &kinds) const
+{
+    kinds.clear();
+    if (!track_kinds || node.kind_row == NO_KIND_ROW || column_kind.empty()) return false;
+    const size_t row = node.kind_row * column_kind.size();
+    for (size_t i = 0; i < column_kind.size(); i++) {
+        if (kind_rows[row + i] > 0) {
+            kinds.push_back(std::make_pair(column_kind[i], static_cast<double>(kind_rows[row + i])));
+        }
+    }
+    std::sort(kinds.begin(), kinds.end(),
+        [](const std::pair<int, double> &a, const std::pair<int, double> &b) {
+        return a.second > b.second;
+    });
     return true;
 }
 
+std::vector<MemoryDump::GraphPath> MemoryDump::top_paths(size_t n)
+{
+    /* min-heap of the n biggest so far */
+    typedef std::pair<double, Node*> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+    for (auto &&pair : nodes) {
+        auto &node = pair.second;
+        if (node.label == 0) continue;
+        if (heap.size() < n) {
+            heap.push(Entry(node.subtree_size, &node));
+        }
+        else if (node.subtree_size > heap.top().first) {
+            heap.pop();
+            heap.push(Entry(node.subtree_size, &node));
+        }
+    }
+
+    std::vector<GraphPath> paths(heap.size());
+    for (auto i = paths.size(); i > 0; i--) {
+        auto node = heap.top().second;
+        heap.pop();
+        auto &path = paths[i - 1];
+
+        /* up through the heaviest chosen parent, to a top node */
+        std::set<uintptr_t> seen;
+        path.nodes.push_back(node);
+        while (seen.insert(node->label).second) {
+            auto priority = top_priority(*node);
+            const ParentNode *edge = nullptr;
+            Node *parent = nullptr;
+            for (const auto &p : node->parents) {
+                if (edge_policy.priority(p, *node) < priority) continue;
+                auto iter = nodes.find(p.label);
+                if (iter != nodes.end() && (parent == nullptr || iter->second.subtree_size > parent->subtree_size)) {
+                    parent = &iter->second;
+                    edge = &p;
+                }
+            }
+            if (parent == nullptr) break;
+            path.nodes.push_back(parent);
+            path.edges.push_back(edge->edge);
+            node = parent;
+        }
+        std::reverse(path.nodes.begin(), path.nodes.end());
+        std::reverse(path.edges.begin(), path.edges.end());
+    }
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        const auto &path = paths[i];
+        std::cout << "#" << i + 1 << " " << static_cast<uint64_t>(path.nodes.back()->subtree_size) << " bytes: ";
+        for (size_t j = 0; j < path.nodes.size(); j++) {
+            std::cout << (j > 0 ? ";" : "") << path.nodes[j]->name.str();
+        }
+        std::cout << std::endl;
+    }
+    return paths;
+}
+
+std::vector<MemoryDump::GraphPath> MemoryDump::retention_paths(Node &target, size_t k)
+{
+    /* breadth first up every recorded parent edge, chosen or not, until a top
+     * node. Each node is expanded at most k times, so the first k paths
+     * found are the k shortest ones that do not loop */
+    std::unordered_set<const Node*> tops;
+    for (const auto &c : top_nodes) {
+        tops.insert(c.node);
+    }
+    struct Step {
+        Node *node;
+        size_t prev; /* index into steps, the child this step came from */
+        const ParentNode *edge;
+    };
+    const size_t none = static_cast<size_t>(-1);
+    std::vector<Step> steps;
+    std::unordered_map<const Node*, size_t> expanded;
+    std::vector<GraphPath> paths;
+
+    Step first = { &target, none, nullptr };
+    steps.push_back(first);
+    for (size_t i = 0; i < steps.size() && paths.size() < k; i++) {
+        auto node = steps[i].node;
+        if (tops.find(node) != tops.end()) {
+            GraphPath path;
+            for (size_t j = i; j != none; j = steps[j].prev) {
+                path.nodes.push_back(steps[j].node);
+                if (steps[j].edge != nullptr) path.edges.push_back(steps[j].edge->edge);
+            }
+            paths.push_back(path);
+            continue;
+        }
+        if (expanded[node]++ >= k) continue;
+        for (const auto &p : node->parents) {
+            auto parent = nodes.find(p.label);
+            if (parent == nodes.end()) continue;
+            bool loop = false;
+            for (size_t j = i; j != none && !loop; j = steps[j].prev) {
+                loop = steps[j].node == &parent->second;
+            }
+            if (loop) continue;
+            Step next = { &parent->second, i, &p };
+            steps.push_back(next);
+        }
+    }
+
+    std::cout << paths.size() << " retention paths to 0x" << std::hex << target.label << std::dec << ":" << std::endl;
+    for (const auto &path : paths) {
+        std::cout << "  ";
+        for (size_t j = 0; j < path.nodes.size(); j++) {
+            if (j > 0) std::cout << " -[" << path.edges[j - 1].str() << "]-> ";
+            std::cout << path.nodes[j]->name.str();
+        }
+        std::cout << std::endl;
+    }
+    return paths;
+}
+
+void MemoryDump::write_paths(const std::vector<GraphPath> &paths, std::ofstream &ofile, const cmd_opt &opt)
+{
+    exporter->write_preamble(ofile);
+    std::set<uintptr_t> declared_nodes;
+    std::set<std::pair<uintptr_t, uintptr_t>> written_edges;
+    for (const auto &path : paths) {
+        for (size_t i = 0; i < path.nodes.size(); i++) {
+            auto node = path.nodes[i];
+            if (declared_nodes.insert(node->label).second) {
+                write_node(*node, ofile, opt);
+            }
+            if (i > 0 && written_edges.insert(std::make_pair(path.nodes[i - 1]->label, node->label)).second) {
+                write_edge(*path.nodes[i - 1], *node, ofile, path.edges[i - 1].str());
+            }
+        }
+    }
+    exporter->write_appendix(ofile);
+}
@@ -21,9 +21,15 @@
 #include <string>
 #include <set>
 #include <unordered_map>
+#include <deque>
+#include <ios>
+#include <cstdint>
 
 #include "kind.h"
 #include "export.h"
+#include "profile.h"
+#include "edge_policy.h"
+#include "columns.h"
 
 enum EdgePriority {
     EDGE_PRIORITY_MIN = 0,
@@ -73,6 +79,11 @@ public:
         return id >= 0 && id < array.size();
     }
 
+    int index() const
+    {
+        return id;
+    }
+
     StringBin(const std::string &s)
     {
         str(s);
@@ -82,6 +93,8 @@ public:
     {
         id = s.id;
     }
+
+    StringBin &operator=(const StringBin &s) = default;
 };
 
 struct ParentNode {
@@ -103,6 +116,11 @@ struct ParentNode {
             priority = EDGE_PRIORITY_CHUNK_VALUE;
         }
     }
+    ParentNode(uintptr_t label_, const StringBin &edge_, enum EdgePriority priority_) :
+        label(label_),
+        edge(edge_),
+        priority(priority_)
+    {}
 };
 
 class ParentNodeComp {
@@ -117,14 +135,20 @@ struct Node;
 struct ChildNode {
     Node* node;
     StringBin edge;
+    bool loop; /* back to a node on the path when sized, which adds nothing */
     ChildNode (Node *node_, const std::string &edge_)
         : node (node_),
-        edge(edge_) {}
+        edge(edge_),
+        loop(false) {}
     ChildNode(Node *node_, const StringBin &edge_)
         : node(node_),
-        edge(edge_) {}
+        edge(edge_),
+        loop(false) {}
 };
 
+const uint32_t NO_KIND_ROW = UINT32_MAX;
+const uint32_t NO_LEVEL_ROW = UINT32_MAX;
+
 struct Node {
     std::set<ParentNode, ParentNodeComp> parents;
     std::vector<ChildNode> children;
@@ -133,47 +157,177 @@ struct Node {
     StringBin name;
     uint32_t size;
     enum Reb_Kind node_type;
+    uint32_t kind_row; /* into MemoryDump::kind_rows, NO_KIND_ROW if none */
+    uint64_t hash; /* of the subtree's shape, see MemoryDump::set_hash_consing() */
+    uint32_t level_row; /* into MemoryDump::hidden_sizes, NO_LEVEL_ROW if none */
     short subtree_size_division; /* how much the subtree_size contributes its parents' subtree_size */
     short visited;
     bool critical;
 
     Node(uintptr_t label_ = 0, const std::string &name_ = "") :
-        label(label_), name(name_),
-        node_type(REB_TRASH),
-        size(0),
+        label(label_),
         subtree_size(0),
+        name(name_),
+        size(0),
+        node_type(REB_TRASH),
+        kind_row(NO_KIND_ROW),
+        hash(0),
+        level_row(NO_LEVEL_ROW),
+        subtree_size_division(0),
         visited(-1),
-        critical(false),
-        subtree_size_division(0) {}
+        critical(false) {}
+};
+
+enum Parse_Result {
+    PARSE_OK,
+    PARSE_FAIL,
+    PARSE_COMMENT
+};
+
+/* one line of the dump: "0xlabel,0xparent,kind,size,edge,name" */
+struct DumpRecord {
+    uintptr_t label;
+    uintptr_t parent;
+    enum Reb_Kind kind;
+    uint32_t size;
+    std::string edge;
+    std::string name;
+    bool has_name;
+};
+
+enum Parse_Result parse_record(const char *buf, DumpRecord &rec);
+
+/* always counted, reported with --profile */
+struct DumpStats {
+    uint64_t lines;
+    uint64_t records;
+    uint64_t parse_failures;
+    uint64_t duplicates;
+    uint64_t edges_kept;
+    uint64_t edges_dropped_priority;
+    uint64_t edges_dropped_missing;
+    uint64_t nodes_written;
+    uint64_t edges_written;
+    uint64_t subtrees_deduplicated;
+
+    DumpStats()
+    {
+        reset();
+    }
+    void reset()
+    {
+        lines = records = parse_failures = duplicates = 0;
+        edges_kept = edges_dropped_priority = edges_dropped_missing = 0;
+        nodes_written = edges_written = subtrees_deduplicated = 0;
+    }
 };
 
 class MemoryDump {
+    friend class ExternalDump;
+    friend class DumpIndex;
+    friend class BinaryDump;
+    friend class NodeFilter;
+    friend class KindReport;
+    friend class ShardExport;
+    friend class GroupBy;
+    friend class LayoutReport;
+    friend class MultiImport;
 private:
-    enum Parse_Result {
-        PARSE_OK,
-        PARSE_FAIL,
-        PARSE_COMMENT
-    };
     enum Parse_Result parse(const char *buf, Node &node);
+    void make_node(const DumpRecord &rec, Node &node);
     bool draw_tree(Node &node, std::ofstream &ofile, const cmd_opt &opt, std::set<uintptr_t> &declared_nodes, int level = 0);
     void clear_visited(Node &);
     void clear_visited();
     void set_critical(const std::vector<ChildNode> &nodes, int level = 0);
+    void clear_critical(const std::vector<ChildNode> &nodes);
+    void report_progress(size_t lines);
+    Node *merge_node(const Node &node, bool &changed);
+    size_t link_node(Node &node);
+    void link_nodes();
+    std::vector<Node*> nodes_by_label();
+    void unlink_node(Node &node, std::set<Node*> &dirty);
+    void recount_divisions(const std::set<Node*> &relink, std::set<Node*> &dirty);
+    void recount_division(Node &node, const std::unordered_map<Node*, bool> &scope, std::set<uintptr_t> &path);
+    double resize_node(Node &node, const std::set<Node*> &dirty, std::set<uintptr_t> &path);
     void pre_update_subtree_size(Node &node, std::set<uintptr_t> &path);
-    Node *find_node(std::vector<std::string> path) const;
     void write_node(const Node &, std::ofstream&, const cmd_opt &);
+    void write_edge(const Node &from, const Node &to, std::ofstream &ofile, const std::string &edge);
+    Node *coarse_node(const std::string &name, double size, enum Reb_Kind kind);
+    bool write_chain(Node &node, ChildNode &c, std::ofstream &ofile, const cmd_opt &opt, std::set<uintptr_t> &declared_nodes, int level);
+    void write_others(Node &node, const std::vector<ChildNode*> &edges, std::ofstream &ofile, const cmd_opt &opt);
+    std::vector<Node*> select_nodes(const cmd_opt &opt);
+    void make_exporter(const cmd_opt &opt);
+    int top_priority(const Node &node) const;
+    void freeze_edges();
+
+    /* nodes[0] is a top node, edges[i] links nodes[i] to nodes[i + 1] */
+    struct GraphPath {
+        std::vector<Node*> nodes;
+        std::vector<StringBin> edges;
+    };
+    std::vector<GraphPath> top_paths(size_t n);
+    std::vector<GraphPath> retention_paths(Node &target, size_t k);
+    void write_paths(const std::vector<GraphPath> &paths, std::ofstream &ofile, const cmd_opt &opt);
+    bool write_graph(std::ofstream &ofile, const cmd_opt &opt);
+    bool write_columns(const ColumnTables &tables, std::ofstream &ofile, const cmd_opt &opt);
+    void init_kind_rows();
+    size_t kind_row(Node &node);
+    void reset_kind_row(Node &node);
+    void add_kinds(Node &to, Node &from, double scale);
+    void select_children(Node &node, const cmd_opt &opt, std::vector<ChildNode*> &edges);
+    bool is_prefix(const Node &node, const std::vector<ChildNode*> &edges) const;
+    void write_tree(const std::vector<Node*> &roots, std::ofstream &ofile, const cmd_opt &opt);
+    double written_below(Node &node, std::unordered_map<Node*, double> &excess);
 
     double total_size;
     double min_size;
     std::unordered_map<uintptr_t, Node> nodes;
     std::vector<ChildNode> top_nodes;
+    std::deque<Node> coarse_nodes; /* "N others" and chain nodes of the export in progress */
+    std::unordered_map<uintptr_t, std::vector<uintptr_t>> dangling; /* parent label => nodes waiting for it */
+    std::string import_path;
+    std::streamoff import_offset;
+    bool following; /* an unterminated last line is left to follow() */
     Exporter *exporter;
+    ColumnTables *columns; /* takes the nodes and edges instead of the exporter, -e COLUMNS */
     enum ExportType export_type;
+    Profile *profile;
+    DumpStats stats;
+    /* per-subtree bytes by kind, one row of floats per node with a column per
+     * kind present in the dump, plus one for kinds that appear later */
+    bool track_kinds;
+    std::vector<int> kind_column; /* kind_slot() => column */
+    std::vector<int> column_kind; /* column => kind, -1 for the last one */
+    std::vector<float> kind_rows;
+
+    EdgePolicy edge_policy;
+    struct FrozenEdge {
+        Node *child;
+        Node *parent; /* nullptr if not in the dump */
+        const ParentNode *edge;
+        bool context; /* from "self" or "???" */
+    };
+    std::vector<FrozenEdge> frozen_edges; /* built on the first reselect_edges() */
+    bool children_sorted; /* by subtree_size, biggest first, see build_levels() */
+    /* node.level_row + k => the share of node's children from rank k on,
+     * what an export showing the first k of them leaves out */
+    std::vector<double> hidden_sizes;
+    bool track_hashes;
+
+    uint64_t subtree_hash(const Node &node, const std::set<uintptr_t> &path) const;
+    void dedup_children(std::vector<ChildNode*> &edges, std::vector<size_t> &copies);
 public:
     MemoryDump()
         :total_size(0),
         min_size(0),
-        exporter(nullptr)
+        import_offset(0),
+        following(false),
+        exporter(nullptr),
+        columns(nullptr),
+        profile(nullptr),
+        track_kinds(false),
+        children_sorted(false),
+        track_hashes(false)
     {}
 
     virtual ~MemoryDump()
@@ -185,9 +339,67 @@ public:
 
     bool import(const std::string &path);
     double update_subtree_size(Node &node, std::set<uintptr_t> &path);
-    double update_subtree_size();
+    double update_subtree_size(bool critical = true);
+    void update_critical();
+    Node *find_node(std::vector<std::string> path) const;
+    const std::vector<ChildNode> &top_level() const
+    {
+        return top_nodes;
+    }
+    size_t node_count() const
+    {
+        return nodes.size();
+    }
+    double update_subtree_size(std::set<Node*> &dirty);
+    /* imports leave an unterminated last line for follow() to read once
+     * the producer completes it */
+    void set_following(bool enable)
+    {
+        following = enable;
+    }
+    /* reads the records appended to the input since the import, returns
+     * how many */
+    size_t follow();
     bool write_output(const cmd_opt &opt);
     void reset();
+    void set_profile(Profile *p)
+    {
+        profile = p;
+    }
+    void report_profile() const;
+    /* hashes every subtree while sizing it, over the kind, size and name of
+     * its nodes and the edge names, so that --dedup can draw siblings with
+     * identical subtrees once */
+    void set_hash_consing(bool enable)
+    {
+        track_hashes = enable;
+    }
+    void set_kind_breakdown(bool enable)
+    {
+        track_kinds = enable;
+    }
+    bool kind_breakdown(const Node &node, std::vector<std::pair<int, double>> &kinds) const;
+    /* takes effect on the next import, or at once with reselect_edges() */
+    void set_edge_policy(const EdgePolicy &policy)
+    {
+        edge_policy = policy;
+    }
+    const EdgePolicy &current_edge_policy() const
+    {
+        return edge_policy;
+    }
+    double reselect_edges();
+    /* the level of detail index: sorts every children list once, biggest
+     * first, and sums what each rank leaves out. The children shown at a
+     * threshold and max_subnodes are then a prefix found by binary search,
+     * and the rest is one lookup, so the exports that follow (and zooming in
+     * the GUI) only walk the visible nodes. Sizing the dump undoes it */
+    void build_levels();
+    /* how many of the node's children show at least min_size bytes, up to
+     * max_subnodes (unlimited if <= 0) */
+    size_t visible_children(const Node &node, double min_size, int max_subnodes) const;
+    /* the share of the node's children from rank `first' on */
+    double hidden_size(const Node &node, size_t first) const;
 };
 
 #endif //D2D_DUMP_H
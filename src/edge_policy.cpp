@@ -0,0 +1,136 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <string.h>
+
+#ifdef _MSC_VER
+#define strcasecmp _stricmp
+#endif
+
+#include "dump.h"
+#include "edge_policy.h"
+
+namespace {
+    bool parse_priority(const std::string &text, int &priority)
+    {
+        const struct {
+            const char *name;
+            int priority;
+        } levels[] = {
+            { "ignore", EdgePolicy::IGNORE },
+            { "min", EDGE_PRIORITY_MIN },
+            { "keeps", EDGE_PRIORITY_CHUNK_VALUE },
+            { "bound-to", EDGE_PRIORITY_BOUND_TO },
+            { "parent", EDGE_PRIORITY_PARENT },
+            { "default", EDGE_PRIORITY_DEFAULT },
+            { "max", EDGE_PRIORITY_MAX }
+        };
+        for (const auto &l : levels) {
+            if (text == l.name) {
+                priority = l.priority;
+                return true;
+            }
+        }
+        char *end = nullptr;
+        priority = static_cast<int>(std::strtol(text.c_str(), &end, 10));
+        return !text.empty() && *end == '\0' && priority >= EDGE_PRIORITY_MIN && priority <= EDGE_PRIORITY_MAX;
+    }
+}
+
+bool EdgePolicy::parse(const std::string &text, std::string &error)
+{
+    rules.clear();
+    context = true;
+    literal = text;
+    size_t start = 0;
+    while (start <= text.size()) {
+        auto end = text.find(',', start);
+        if (end == std::string::npos) end = text.size();
+        auto rule = text.substr(start, end - start);
+        start = end + 1;
+        if (rule.empty()) continue;
+
+        auto eq = rule.rfind('=');
+        if (eq == std::string::npos || eq == 0) {
+            error = "'" + rule + "' is not edge=priority";
+            return false;
+        }
+        auto lhs = rule.substr(0, eq);
+        auto rhs = rule.substr(eq + 1);
+        if (lhs == "context") {
+            if (rhs != "keep" && rhs != "off") {
+                error = "context is keep or off";
+                return false;
+            }
+            context = rhs == "keep";
+            continue;
+        }
+
+        Rule r;
+        r.kind = -1;
+        auto colon = lhs.find(':');
+        if (colon != std::string::npos && colon > 0 && lhs[0] != '<') {
+            auto kind = lhs.substr(0, colon);
+            for (int slot = 0; slot < KIND_SLOT_COUNT; slot++) {
+                if (!strcasecmp(kind.c_str(), kind_names[slot])) r.kind = slot_kind(slot);
+            }
+            if (r.kind < 0) {
+                error = "unknown kind '" + kind + "'";
+                return false;
+            }
+            lhs = lhs.substr(colon + 1);
+        }
+        r.edge = lhs;
+        if (!parse_priority(rhs, r.priority)) {
+            error = "unknown priority '" + rhs + "'";
+            return false;
+        }
+        rules.push_back(r);
+    }
+    resolve();
+    return true;
+}
+
+void EdgePolicy::resolve()
+{
+    by_edge.assign(StringBin::array.size(), NONE);
+    by_kind_edge.clear();
+    for (const auto &r : rules) {
+        auto iter = StringBin::set.find(r.edge);
+        if (iter == StringBin::set.end()) continue;
+        int id = iter->second.first;
+        if (r.kind < 0) {
+            by_edge[id] = r.priority;
+        }
+        else {
+            by_kind_edge.push_back(std::make_pair(id, std::make_pair(r.kind, r.priority)));
+        }
+    }
+}
+
+int EdgePolicy::priority(const ParentNode &p, const Node &child) const
+{
+    int id = p.edge.index();
+    for (const auto &k : by_kind_edge) {
+        if (k.first == id && k.second.first == child.node_type) return k.second.second;
+    }
+    if (id >= 0 && id < static_cast<int>(by_edge.size()) && by_edge[id] != NONE) {
+        return by_edge[id];
+    }
+    return p.priority;
+}
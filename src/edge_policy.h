@@ -0,0 +1,71 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_EDGE_POLICY_H
+#define D2D_EDGE_POLICY_H
+
+#include <string>
+#include <vector>
+
+struct Node;
+struct ParentNode;
+
+/* Which parents a node hangs under: those whose priority is the highest of
+ * its parents. The default gives every edge its EdgePriority and leaves
+ * the edges from "self" and "???" out of the comparison (they are kept
+ * whenever they reach the top priority). --edge-policy overrides it with
+ * comma separated rules:
+ *
+ *     <bound-to>=ignore,GOB:<parent>=max,context=off
+ *
+ * An edge name, optionally restricted to the kind of the child, set to
+ * ignore, min, keeps, bound-to, parent, default, max or a number */
+class EdgePolicy {
+private:
+    struct Rule {
+        std::string edge;
+        int kind; /* -1 for any */
+        int priority;
+    };
+    std::vector<Rule> rules;
+    bool context; /* the "self"/"???" exception */
+    std::string literal;
+
+    /* per edge string id, resolved against the string table */
+    std::vector<int> by_edge;
+    std::vector<std::pair<int, std::pair<int, int>>> by_kind_edge; /* edge id => kind, priority */
+public:
+    enum {
+        IGNORE = -1,
+        NONE = -2
+    };
+
+    EdgePolicy() : context(true) {}
+
+    bool parse(const std::string &text, std::string &error);
+    void resolve();
+    bool keep_context() const
+    {
+        return context;
+    }
+    const std::string &str() const
+    {
+        return literal;
+    }
+    int priority(const ParentNode &p, const Node &child) const;
+};
+
+#endif //D2D_EDGE_POLICY_H
@@ -0,0 +1,128 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#include <cmath>
+#include <cstdio>
+
+#include "dump.h"
+#include "export_tree.h"
+
+namespace {
+    std::string frame_name(const Node &node)
+    {
+        std::string name = node.name.str();
+        if (name.empty()) {
+            name = kind_name(node.node_type);
+        }
+        return name;
+    }
+}
+
+void write_json_string(const std::string &s, std::ostream &os)
+{
+    os << '"';
+    for (auto c : s) {
+        switch (c) {
+        case '"': os << "\\\""; break;
+        case '\\': os << "\\\\"; break;
+        case '\n': os << "\\n"; break;
+        case '\t': os << "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
+                os << buf;
+            }
+            else {
+                os << c;
+            }
+        }
+    }
+    os << '"';
+}
+
+void ExporterFolded::write_preamble(std::ofstream &)
+{
+    stack.clear();
+    frames.clear();
+}
+
+void ExporterFolded::enter(const Node &node, const std::string &, std::ofstream &)
+{
+    frames.push_back(stack.size());
+    if (!stack.empty()) stack += ';';
+    /* ';' separates frames and the count follows the last space */
+    for (auto c : frame_name(node)) {
+        stack += (c == ';' || c == '\n' || c == '\r') ? '_' : c;
+    }
+}
+
+void ExporterFolded::leave(const Node &, double self, double, std::ofstream &ofile)
+{
+    auto n = std::llround(self);
+    if (n > 0) {
+        ofile << stack << ' ' << n << '\n';
+    }
+    stack.resize(frames.back());
+    frames.pop_back();
+}
+
+void ExporterFolded::write_appendix(double, std::ofstream &)
+{
+}
+
+void ExporterJSON::write_preamble(std::ofstream &ofile)
+{
+    ofile << "{\"name\": \"(root)\", \"children\": [";
+    has_children.assign(1, false);
+}
+
+void ExporterJSON::enter(const Node &node, const std::string &edge, std::ofstream &ofile)
+{
+    if (has_children.back()) ofile << ',';
+    has_children.back() = true;
+    has_children.push_back(false);
+
+    char label[24];
+    std::snprintf(label, sizeof(label), "0x%llx", static_cast<unsigned long long>(node.label));
+    ofile << "\n{\"name\": ";
+    write_json_string(frame_name(node), ofile);
+    ofile << ", \"kind\": \"" << kind_name(node.node_type)
+        << "\", \"label\": \"" << label << "\", \"edge\": ";
+    write_json_string(edge, ofile);
+    ofile << ", \"children\": [";
+}
+
+void ExporterJSON::leave(const Node &node, double self, double total, std::ofstream &ofile)
+{
+    /* sizes go last, they are only known once the children are written */
+    has_children.pop_back();
+    ofile << "], \"value\": " << std::llround(self) << ", \"total\": " << std::llround(total);
+    if (dump != nullptr && dump->kind_breakdown(node, kinds)) {
+        ofile << ", \"kinds\": {";
+        for (size_t i = 0; i < kinds.size(); i++) {
+            ofile << (i > 0 ? ", " : "") << '"' << (kinds[i].first < 0 ? "OTHER" : kind_name(kinds[i].first))
+                << "\": " << std::llround(kinds[i].second);
+        }
+        ofile << "}";
+    }
+    ofile << "}";
+}
+
+void ExporterJSON::write_appendix(double total, std::ofstream &ofile)
+{
+    ofile << "], \"value\": 0, \"total\": " << std::llround(total) << "}\n";
+}
@@ -0,0 +1,82 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_EXPORT_TREE_H
+#define D2D_EXPORT_TREE_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct Node;
+class MemoryDump;
+
+enum TreeExportType {
+    TREE_EXPORT_NONE,
+    TREE_EXPORT_FOLDED,
+    TREE_EXPORT_JSON
+};
+
+/* `s' as a quoted JSON string, control characters escaped as \u00XX.
+ * Shared by every writer of JSON output */
+void write_json_string(const std::string &s, std::ostream &os);
+
+/* Exporters for graphs too big to lay out: MemoryDump::write_tree walks
+ * the size-sorted tree once, depth first, and calls enter/leave for every
+ * node. Each node is written under the first parent it is reached from only,
+ * so that nothing is counted twice. `self' is the node's size plus the
+ * share of the children that were not written (-t, -m, -d), `total' adds
+ * the totals of the written ones */
+class TreeExporter {
+public:
+    virtual void write_preamble(std::ofstream &ofile) = 0;
+    virtual void enter(const Node &node, const std::string &edge, std::ofstream &ofile) = 0;
+    virtual void leave(const Node &node, double self, double total, std::ofstream &ofile) = 0;
+    virtual void write_appendix(double total, std::ofstream &ofile) = 0;
+    virtual ~TreeExporter() {}
+};
+
+/* "root;child;grandchild self" lines, as flamegraph.pl and friends read them */
+class ExporterFolded : public TreeExporter {
+private:
+    std::string stack;
+    std::vector<size_t> frames; /* length of stack before each frame */
+public:
+    void write_preamble(std::ofstream &ofile);
+    void enter(const Node &node, const std::string &edge, std::ofstream &ofile);
+    void leave(const Node &node, double self, double total, std::ofstream &ofile);
+    void write_appendix(double total, std::ofstream &ofile);
+};
+
+/* nested {"name", "children"} objects, as d3-hierarchy based treemaps read
+ * them, with the bytes by kind of each subtree if the dump tracks them.
+ * "value" is the node's own bytes (`self'), which hierarchy.sum() adds
+ * up, "total" the bytes of the subtree as written */
+class ExporterJSON : public TreeExporter {
+private:
+    const MemoryDump *dump;
+    std::vector<bool> has_children; /* per open object */
+    std::vector<std::pair<int, double>> kinds;
+public:
+    ExporterJSON(const MemoryDump *dump_ = nullptr) : dump(dump_) {}
+
+    void write_preamble(std::ofstream &ofile);
+    void enter(const Node &node, const std::string &edge, std::ofstream &ofile);
+    void leave(const Node &node, double self, double total, std::ofstream &ofile);
+    void write_appendix(double total, std::ofstream &ofile);
+};
+
+#endif //D2D_EXPORT_TREE_H
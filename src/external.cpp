@@ -0,0 +1,466 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <unordered_set>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#endif
+
+#include "dump.h"
+#include "external.h"
+
+namespace {
+    struct RecordLess {
+        bool operator () (const ExternalDump::Record &a, const ExternalDump::Record &b) const {
+            return a.label < b.label || (a.label == b.label && a.seq < b.seq);
+        }
+    };
+
+    struct EdgeParentLess {
+        bool operator () (const ExternalDump::EdgeRecord &a, const ExternalDump::EdgeRecord &b) const {
+            return a.parent < b.parent || (a.parent == b.parent && a.child < b.child);
+        }
+    };
+
+    struct EdgeChildLess {
+        bool operator () (const ExternalDump::EdgeRecord &a, const ExternalDump::EdgeRecord &b) const {
+            return a.child < b.child || (a.child == b.child && a.parent < b.parent);
+        }
+    };
+
+    const char *spill_files[] = {
+        "records.bin", "nodes.bin", "nodes-div.bin", "edges.bin", "edges-joined.bin",
+        "chosen.bin", "offsets.bin", "children.bin", "subtree.bin", "state.bin",
+        "division.bin", "seen.bin", "loops.bin"
+    };
+}
+
+ExternalDump::ExternalDump(size_t memory_budget_, const std::string &tmp_dir)
+    : memory_budget(memory_budget_),
+    nodes_count(0),
+    chosen_count(0),
+    total_size(0)
+{
+    std::string dir = tmp_dir;
+    if (dir.empty()) {
+        const char *env = std::getenv("TMPDIR");
+        dir = env != nullptr ? env : "/tmp";
+    }
+    prefix = dir + "/d2d-" + std::to_string(getpid()) + "-";
+}
+
+ExternalDump::~ExternalDump()
+{
+    for (auto name : spill_files) {
+        std::remove(path(name).c_str());
+    }
+}
+
+std::string ExternalDump::path(const char *name) const
+{
+    return prefix + name;
+}
+
+bool ExternalDump::spill_records(const std::string &input)
+{
+    ExternalSorter<Record, RecordLess> sorter(path("sort"), memory_budget);
+
+    /* the synthetic top node import() inserts */
+    Record nil = { 0, 0, 0, StringBin("NIL").index(), StringBin("").index(), 0, REB_TRASH };
+    sorter.push(nil);
+
+    std::ifstream fi(input);
+    if (!fi.good()) {
+        std::cout << "Failed to open " << input << std::endl;
+        return false;
+    }
+    std::string line;
+    size_t i = 0;
+    DumpRecord rec;
+    while (std::getline(fi, line)) {
+        ++i;
+        Parse_Result parse_result;
+        try {
+            parse_result = parse_record(line.c_str(), rec);
+        }
+        catch (...) {
+            parse_result = PARSE_FAIL;
+        }
+        if (parse_result == PARSE_FAIL) {
+            std::cout << "Failed to parse line " << i << ": " << line << std::endl;
+            continue;
+        }
+        else if (parse_result == PARSE_COMMENT) {
+            continue;
+        }
+        Record r;
+        r.label = rec.label;
+        r.parent = rec.parent;
+        r.seq = i;
+        r.name = rec.has_name ? StringBin(rec.name).index() : -1;
+        r.edge = StringBin(rec.edge).index();
+        r.size = rec.size;
+        r.kind = rec.kind;
+        sorter.push(r);
+        if (i % 1000000 == 0) {
+            std::cout << "Spilled " << i << " lines" << std::endl;
+        }
+    }
+    sorter.finish(path("records.bin"));
+    if (!sorter.good()) {
+        std::cout << "Failed to write " << path("records.bin") << std::endl;
+        return false;
+    }
+    std::cout << i << " lines spilled" << std::endl;
+    return true;
+}
+
+/* collapse records with the same label into one node, the first record
+ * wins like in MemoryDump::import, and emit one edge per distinct parent */
+bool ExternalDump::merge_records()
+{
+    RecordReader<Record> records(path("records.bin"));
+    RecordWriter<NodeRecord> nodes(path("nodes.bin"));
+    RecordWriter<EdgeRecord> edges(path("edges.bin"));
+
+    Record r;
+    bool has_current = false;
+    uint64_t current = 0;
+    std::unordered_set<uint64_t> parents;
+    while (records.next(r)) {
+        if (!has_current || r.label != current) {
+            NodeRecord n = { r.label, r.name, r.size, r.kind, 0 };
+            nodes.push(n);
+            current = r.label;
+            has_current = true;
+            parents.clear();
+        }
+        if (r.label == 0 && r.seq == 0) continue; /* NIL has no parent */
+        if (!parents.insert(r.parent).second) continue;
+        EdgeRecord e;
+        e.parent = r.parent;
+        e.child = r.label;
+        e.edge = r.edge;
+        e.priority = ParentNode(r.parent, StringBin::array[r.edge]).priority;
+        e.flags = 0;
+        edges.push(e);
+    }
+    nodes.close();
+    edges.close();
+    nodes_count = nodes.size();
+    std::cout << nodes_count << " nodes, " << edges.size() << " edges after merging duplicates" << std::endl;
+    std::remove(path("records.bin").c_str());
+    return nodes.good() && edges.good();
+}
+
+/* sort-merge join of the edges with their parent nodes */
+bool ExternalDump::join_parents()
+{
+    {
+        ExternalSorter<EdgeRecord, EdgeParentLess> by_parent(path("sort"), memory_budget);
+        {
+            RecordReader<EdgeRecord> edges(path("edges.bin"));
+            EdgeRecord e;
+            while (edges.next(e)) {
+                by_parent.push(e);
+            }
+        }
+        by_parent.finish(path("edges.bin"));
+        if (!by_parent.good()) return false;
+    }
+
+    ExternalSorter<EdgeRecord, EdgeChildLess> by_child(path("sort"), memory_budget);
+    RecordReader<EdgeRecord> edges(path("edges.bin"));
+    RecordReader<NodeRecord> nodes(path("nodes.bin"));
+    EdgeRecord e;
+    while (edges.next(e)) {
+        const NodeRecord *n;
+        while ((n = nodes.peek()) != nullptr && n->label < e.parent) {
+            NodeRecord skip;
+            nodes.next(skip);
+        }
+        if (n != nullptr && n->label == e.parent) {
+            e.flags |= EDGE_PARENT_EXISTS;
+            if (n->name >= 0) {
+                const auto &pname = StringBin::array[n->name];
+                if (pname == "self" || pname == "???") { // always keep the edges from self and ??? to its context
+                    e.flags |= EDGE_PARENT_SELF;
+                }
+            }
+        }
+        by_child.push(e);
+    }
+    by_child.finish(path("edges-joined.bin"));
+    std::remove(path("edges.bin").c_str());
+    return by_child.good();
+}
+
+/* pick the top priority parents of every node, as MemoryDump::import does */
+bool ExternalDump::select_edges()
+{
+    ExternalSorter<EdgeRecord, EdgeParentLess> chosen(path("sort"), memory_budget);
+    RecordReader<EdgeRecord> edges(path("edges-joined.bin"));
+    RecordReader<NodeRecord> nodes(path("nodes.bin"));
+    RecordWriter<NodeRecord> out(path("nodes-div.bin"));
+
+    std::vector<EdgeRecord> group;
+    NodeRecord n;
+    uint64_t id = 0;
+    while (nodes.next(n)) {
+        group.clear();
+        const EdgeRecord *e;
+        while ((e = edges.peek()) != nullptr && e->child == n.label) {
+            group.push_back(*e);
+            EdgeRecord skip;
+            edges.next(skip);
+        }
+
+        int priority = EDGE_PRIORITY_MIN;
+        for (const auto & g : group) {
+            if (g.priority > priority && !(g.flags & EDGE_PARENT_SELF)) {
+                priority = g.priority;
+            }
+        }
+        n.parents = 0;
+        for (auto g : group) {
+            if (g.priority >= priority && (g.flags & EDGE_PARENT_EXISTS)) {
+                g.child = id; /* dense id, the position in nodes.bin */
+                chosen.push(g);
+                ++n.parents;
+            }
+        }
+        out.push(n);
+        ++id;
+    }
+    out.close();
+    chosen_count = chosen.finish(path("chosen.bin"));
+    std::remove(path("edges-joined.bin").c_str());
+    if (!out.good() || !chosen.good()) return false;
+    std::remove(path("nodes.bin").c_str());
+    return std::rename(path("nodes-div.bin").c_str(), path("nodes.bin").c_str()) == 0;
+}
+
+/* children of every node as a compressed sparse row over dense ids */
+bool ExternalDump::build_children()
+{
+    MappedArray<uint64_t> offsets;
+    if (!offsets.map(path("offsets.bin"), nodes_count + 1)) return false;
+    RecordWriter<EdgeRecord> children(path("children.bin"));
+    RecordReader<EdgeRecord> edges(path("chosen.bin"));
+    RecordReader<NodeRecord> nodes(path("nodes.bin"));
+
+    NodeRecord n;
+    uint64_t id = 0;
+    while (nodes.next(n)) {
+        offsets[id] = children.size();
+        const EdgeRecord *e;
+        while ((e = edges.peek()) != nullptr && e->parent == n.label) {
+            EdgeRecord c;
+            edges.next(c);
+            c.parent = id;
+            children.push(c);
+        }
+        ++id;
+    }
+    offsets[id] = children.size();
+    children.close();
+    std::remove(path("chosen.bin").c_str());
+    return children.good();
+}
+
+/* the two sizing passes of update_subtree_size(), as iterative
+ * depth-first walks over the disk-resident arrays. A node reached k times
+ * contributes 1/k of its size each time */
+bool ExternalDump::compute_subtree_size()
+{
+    MappedArray<NodeRecord> nodes;
+    MappedArray<uint64_t> offsets;
+    MappedArray<EdgeRecord> children;
+    MappedArray<double> subtree;
+    MappedArray<uint8_t> state;
+    MappedArray<uint32_t> division;
+    MappedArray<uint8_t> loops; /* per child edge, ChildNode::loop */
+    if (!nodes.map(path("nodes.bin")) || !offsets.map(path("offsets.bin"))
+        || !children.map(path("children.bin")) || !subtree.map(path("subtree.bin"), nodes_count)
+        || !state.map(path("state.bin"), nodes_count) || !division.map(path("division.bin"), nodes_count)
+        || (children.size() > 0 && !loops.map(path("loops.bin"), children.size()))) {
+        return false;
+    }
+
+    enum { UNVISITED = 0, ON_PATH, DONE };
+    struct Frame {
+        uint64_t id;
+        uint64_t next;
+    };
+    std::vector<Frame> stack;
+
+    /* like pre_update_subtree_size(): from every top node, count the
+     * arrivals at each node except along a back edge, so that cycles and
+     * parents out of reach of the top nodes do not dilute it */
+    {
+        MappedArray<uint64_t> seen; /* the top node whose walk reached it, plus one */
+        if (!seen.map(path("seen.bin"), nodes_count)) return false;
+        for (uint64_t top = 0; top < nodes_count; top++) {
+            if (nodes[top].parents != 0) continue;
+            ++division[top];
+            seen[top] = top + 1;
+            state[top] = ON_PATH;
+            stack.push_back({ top, offsets[top] });
+            while (!stack.empty()) {
+                auto &f = stack.back();
+                if (f.next < offsets[f.id + 1]) {
+                    auto c = children[f.next++].child;
+                    if (state[c] == ON_PATH) continue;
+                    ++division[c];
+                    if (seen[c] == top + 1) continue;
+                    seen[c] = top + 1;
+                    state[c] = ON_PATH;
+                    stack.push_back({ c, offsets[c] });
+                }
+                else {
+                    state[f.id] = UNVISITED;
+                    stack.pop_back();
+                }
+            }
+        }
+    }
+    std::remove(path("seen.bin").c_str());
+
+    auto contribution = [&](uint64_t id) {
+        return subtree[id] / std::max<uint32_t>(division[id], 1);
+    };
+
+    total_size = 0;
+    for (uint64_t top = 0; top < nodes_count; top++) {
+        if (nodes[top].parents != 0) continue;
+        state[top] = ON_PATH;
+        subtree[top] = nodes[top].size;
+        stack.push_back({ top, offsets[top] });
+        while (!stack.empty()) {
+            auto &f = stack.back();
+            if (f.next < offsets[f.id + 1]) {
+                auto e = f.next++;
+                auto c = children[e].child;
+                if (state[c] == UNVISITED) {
+                    state[c] = ON_PATH;
+                    subtree[c] = nodes[c].size;
+                    stack.push_back({ c, offsets[c] });
+                }
+                else if (state[c] == DONE) {
+                    subtree[f.id] += contribution(c);
+                }
+                else {
+                    loops[e] = 1; /* a cycle, which adds nothing */
+                }
+            }
+            else {
+                auto id = f.id;
+                state[id] = DONE;
+                stack.pop_back();
+                if (!stack.empty()) {
+                    subtree[stack.back().id] += contribution(id);
+                }
+            }
+        }
+        total_size += subtree[top];
+    }
+    return true;
+}
+
+bool ExternalDump::import(const std::string &input)
+{
+    std::cout << "Out-of-core import with a " << (memory_budget >> 20) << " MB budget, spilling to " << prefix << "*" << std::endl;
+    if (!spill_records(input)) return false;
+    if (!merge_records() || !join_parents() || !select_edges()
+        || !build_children() || !compute_subtree_size()) {
+        std::cout << "Failed to write the spill files " << prefix << "*" << std::endl;
+        return false;
+    }
+    std::cout << chosen_count << " edges kept, total size: " << total_size << std::endl;
+    return true;
+}
+
+bool ExternalDump::load(MemoryDump &dump, double threshold, const std::vector<uintptr_t> &labels)
+{
+    if (threshold <= 0) {
+        std::cout << "Warning: without a threshold every node is loaded into memory" << std::endl;
+    }
+    double min_size = total_size * threshold;
+    std::unordered_set<uintptr_t> wanted(labels.begin(), labels.end());
+
+    MappedArray<NodeRecord> nodes;
+    MappedArray<uint64_t> offsets;
+    MappedArray<EdgeRecord> children;
+    MappedArray<double> subtree;
+    MappedArray<uint8_t> state;
+    MappedArray<uint32_t> division;
+    MappedArray<uint8_t> loops;
+    nodes.map(path("nodes.bin"));
+    offsets.map(path("offsets.bin"));
+    children.map(path("children.bin"));
+    subtree.map(path("subtree.bin"));
+    division.map(path("division.bin"));
+    loops.map(path("loops.bin"));
+    if (!state.map(path("state.bin"), nodes_count)) return false;
+
+    const uint8_t LOADED = 1;
+    dump.reset();
+    for (uint64_t id = 0; id < nodes_count; id++) {
+        const auto &n = nodes[id];
+        if (subtree[id] < min_size && wanted.find(n.label) == wanted.end()) continue;
+        state[id] = LOADED;
+        auto &node = dump.nodes[n.label];
+        node.label = n.label;
+        node.node_type = static_cast<enum Reb_Kind>(n.kind);
+        node.size = n.size;
+        node.subtree_size = subtree[id];
+        node.subtree_size_division = static_cast<short>(std::max<uint32_t>(division[id], 1));
+        if (n.name < 0) {
+            node.name.erase();
+        }
+        else {
+            node.name.str(StringBin::array[n.name]);
+        }
+        if (n.parents == 0) {
+            dump.top_nodes.push_back(ChildNode(&node, ""));
+        }
+    }
+
+    for (uint64_t id = 0; id < nodes_count; id++) {
+        if (state[id] != LOADED) continue;
+        auto &parent = dump.nodes[nodes[id].label];
+        for (auto e = offsets[id]; e < offsets[id + 1]; e++) {
+            const auto &c = children[e];
+            if (state[c.child] != LOADED) continue;
+            auto &child = dump.nodes[nodes[c.child].label];
+            const auto &edge = StringBin::array[c.edge];
+            parent.children.push_back(ChildNode(&child, edge));
+            parent.children.back().loop = e < loops.size() && loops[e] != 0;
+            child.parents.insert(ParentNode(parent.label, edge));
+        }
+    }
+    std::cout << dump.nodes.size() << " of " << nodes_count << " nodes loaded" << std::endl;
+
+    dump.total_size = total_size;
+    dump.set_critical(dump.top_nodes);
+    dump.clear_visited();
+    return true;
+}
@@ -0,0 +1,388 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_EXTERNAL_H
+#define D2D_EXTERNAL_H
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <queue>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+class MemoryDump;
+
+/* Buffered reader/writer of fixed-size records in a spill file */
+template <typename T>
+class RecordWriter {
+private:
+    std::FILE *file;
+    std::vector<T> buf;
+    size_t count;
+    bool failed; /* could not open or write the file, a full disk say */
+public:
+    RecordWriter(const std::string &path, size_t buffered = 4096)
+        : file(std::fopen(path.c_str(), "wb")),
+        count(0),
+        failed(file == nullptr)
+    {
+        buf.reserve(std::max<size_t>(buffered, 1));
+    }
+
+    ~RecordWriter()
+    {
+        close();
+    }
+
+    /* every record so far written, or buffered */
+    bool good() const
+    {
+        return !failed;
+    }
+
+    void push(const T &rec)
+    {
+        buf.push_back(rec);
+        ++count;
+        if (buf.size() == buf.capacity()) flush();
+    }
+
+    void flush()
+    {
+        if (file != nullptr && !buf.empty()
+            && std::fwrite(buf.data(), sizeof(T), buf.size(), file) != buf.size()) {
+            failed = true;
+        }
+        buf.clear();
+    }
+
+    void close()
+    {
+        flush();
+        if (file != nullptr) {
+            if (std::fclose(file) != 0) failed = true;
+            file = nullptr;
+        }
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+};
+
+template <typename T>
+class RecordReader {
+private:
+    std::FILE *file;
+    std::vector<T> buf;
+    size_t pos;
+    size_t len;
+public:
+    RecordReader(const std::string &path, size_t buffered = 4096)
+        : file(std::fopen(path.c_str(), "rb")),
+        buf(std::max<size_t>(buffered, 1)),
+        pos(0),
+        len(0)
+    {}
+
+    ~RecordReader()
+    {
+        if (file != nullptr) std::fclose(file);
+    }
+
+    bool good() const
+    {
+        return file != nullptr;
+    }
+
+    const T *peek()
+    {
+        if (pos == len) {
+            if (file == nullptr) return nullptr;
+            len = std::fread(buf.data(), sizeof(T), buf.size(), file);
+            pos = 0;
+            if (len == 0) return nullptr;
+        }
+        return &buf[pos];
+    }
+
+    bool next(T &rec)
+    {
+        auto p = peek();
+        if (p == nullptr) return false;
+        rec = *p;
+        ++pos;
+        return true;
+    }
+};
+
+/* A file mapped into memory as an array, so that the kernel, not the heap, holds it */
+template <typename T>
+class MappedArray {
+private:
+    T *ptr;
+    size_t len;
+#ifdef _WIN32
+    std::vector<T> fallback;
+#endif
+public:
+    MappedArray() : ptr(nullptr), len(0) {}
+    ~MappedArray()
+    {
+        unmap();
+    }
+
+    /* map an existing file read-only, or create a zero-filled file of n elements if n > 0 */
+    bool map(const std::string &path, size_t n = 0);
+    void unmap();
+
+    T &operator [] (size_t i) { return ptr[i]; }
+    const T &operator [] (size_t i) const { return ptr[i]; }
+    size_t size() const { return len; }
+    T *begin() { return ptr; }
+    T *end() { return ptr + len; }
+};
+
+template <typename T>
+bool MappedArray<T>::map(const std::string &path, size_t n)
+{
+    unmap();
+#ifdef _WIN32
+    if (n > 0) {
+        fallback.assign(n, T());
+    }
+    else {
+        std::ifstream fi(path, std::ifstream::binary | std::ifstream::ate);
+        if (!fi.good()) return false;
+        fallback.resize(static_cast<size_t>(fi.tellg()) / sizeof(T));
+        fi.seekg(0);
+        fi.read(reinterpret_cast<char*>(fallback.data()), fallback.size() * sizeof(T));
+    }
+    ptr = fallback.data();
+    len = fallback.size();
+    return true;
+#else
+    int fd = n > 0 ? ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600) : ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    size_t bytes;
+    if (n > 0) {
+        bytes = n * sizeof(T);
+        if (::ftruncate(fd, bytes) != 0) {
+            ::close(fd);
+            return false;
+        }
+    }
+    else {
+        auto end = ::lseek(fd, 0, SEEK_END);
+        bytes = end > 0 ? static_cast<size_t>(end) : 0;
+    }
+    len = bytes / sizeof(T);
+    if (len == 0) {
+        ::close(fd);
+        return true;
+    }
+    void *p = ::mmap(nullptr, bytes, n > 0 ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        len = 0;
+        return false;
+    }
+    ptr = static_cast<T*>(p);
+    return true;
+#endif
+}
+
+template <typename T>
+void MappedArray<T>::unmap()
+{
+#ifdef _WIN32
+    std::vector<T>().swap(fallback);
+#else
+    if (ptr != nullptr) {
+        ::munmap(ptr, len * sizeof(T));
+    }
+#endif
+    ptr = nullptr;
+    len = 0;
+}
+
+/* Sort fixed-size records larger than memory: sorted runs of at most
+ * `budget' bytes are spilled to disk, then merged into `out' */
+template <typename T, typename Less>
+class ExternalSorter {
+private:
+    std::string prefix;
+    size_t budget;
+    Less less;
+    std::vector<T> run;
+    std::vector<std::string> runs;
+    bool failed;
+
+    void spill()
+    {
+        if (run.empty()) return;
+        std::sort(run.begin(), run.end(), less);
+        auto path = prefix + "-run" + std::to_string(runs.size()) + ".bin";
+        RecordWriter<T> w(path);
+        for (const auto & r : run) {
+            w.push(r);
+        }
+        w.close();
+        if (!w.good()) failed = true;
+        runs.push_back(path);
+        run.clear();
+    }
+
+public:
+    ExternalSorter(const std::string &prefix_, size_t budget_, Less less_ = Less())
+        : prefix(prefix_),
+        budget(std::max<size_t>(budget_ / sizeof(T), 1024)),
+        less(less_),
+        failed(false)
+    {
+        run.reserve(budget);
+    }
+
+    void push(const T &rec)
+    {
+        run.push_back(rec);
+        if (run.size() >= budget) spill();
+    }
+
+    size_t finish(const std::string &out)
+    {
+        spill();
+        std::vector<T>().swap(run);
+
+        RecordWriter<T> w(out);
+        if (!runs.empty()) {
+            auto per_run = std::max<size_t>(budget / (runs.size() + 1), 256);
+            std::vector<RecordReader<T>*> readers;
+            for (const auto & path : runs) {
+                readers.push_back(new RecordReader<T>(path, per_run));
+            }
+            /* ties are broken by run order so that the merge is stable */
+            auto cmp = [&](size_t a, size_t b) {
+                const T &x = *readers[a]->peek(), &y = *readers[b]->peek();
+                if (less(y, x)) return true;
+                if (less(x, y)) return false;
+                return a > b;
+            };
+            std::priority_queue<size_t, std::vector<size_t>, decltype(cmp)> heap(cmp);
+            for (size_t i = 0; i < readers.size(); i++) {
+                if (!readers[i]->good()) failed = true;
+                if (readers[i]->peek() != nullptr) heap.push(i);
+            }
+            T rec;
+            while (!heap.empty()) {
+                auto i = heap.top();
+                heap.pop();
+                readers[i]->next(rec);
+                w.push(rec);
+                if (readers[i]->peek() != nullptr) heap.push(i);
+            }
+            for (size_t i = 0; i < readers.size(); i++) {
+                delete readers[i];
+                std::remove(runs[i].c_str());
+            }
+            runs.clear();
+        }
+        w.close();
+        if (!w.good()) failed = true;
+        return w.size();
+    }
+
+    /* false once a run or the output could not be written or read back */
+    bool good() const
+    {
+        return !failed;
+    }
+};
+
+/* Out-of-core import: parsed records, edges and per-node arrays live in
+ * spill files under `tmp_dir', only `memory_budget' bytes are used for
+ * sorting, and only nodes above the export threshold are loaded into a
+ * MemoryDump at the end */
+class ExternalDump {
+public:
+    struct Record {
+        uint64_t label;
+        uint64_t parent;
+        uint64_t seq;
+        int32_t name;
+        int32_t edge;
+        uint32_t size;
+        int32_t kind;
+    };
+
+    struct NodeRecord {
+        uint64_t label;
+        int32_t name;
+        uint32_t size;
+        int32_t kind;
+        uint32_t parents; /* number of chosen parents, 0 for a top node */
+    };
+
+    struct EdgeRecord {
+        uint64_t parent;
+        uint64_t child;
+        int32_t edge;
+        int16_t priority;
+        int16_t flags;
+    };
+
+    enum {
+        EDGE_PARENT_EXISTS = 1,
+        EDGE_PARENT_SELF = 2 /* parent is "self" or "???" */
+    };
+
+private:
+    size_t memory_budget;
+    std::string prefix;
+    size_t nodes_count;
+    size_t chosen_count;
+    double total_size;
+
+    std::string path(const char *name) const;
+    bool spill_records(const std::string &input);
+    bool merge_records();
+    bool join_parents();
+    bool select_edges();
+    bool build_children();
+    bool compute_subtree_size();
+public:
+    ExternalDump(size_t memory_budget_, const std::string &tmp_dir = "");
+    ~ExternalDump();
+
+    bool import(const std::string &input);
+    bool load(MemoryDump &dump, double threshold, const std::vector<uintptr_t> &labels);
+    double total() const
+    {
+        return total_size;
+    }
+};
+
+#endif //D2D_EXTERNAL_H
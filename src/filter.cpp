@@ -0,0 +1,415 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+
+#include "dump.h"
+#include "filter.h"
+
+namespace {
+    template <typename T>
+    void compare(const std::vector<T> &column, int op, double value, std::vector<uint8_t> &mask)
+    {
+        const size_t n = column.size();
+        switch (op) {
+        case 0: for (size_t i = 0; i < n; i++) mask[i] = column[i] == value; break;
+        case 1: for (size_t i = 0; i < n; i++) mask[i] = column[i] != value; break;
+        case 2: for (size_t i = 0; i < n; i++) mask[i] = column[i] < value; break;
+        case 3: for (size_t i = 0; i < n; i++) mask[i] = column[i] <= value; break;
+        case 4: for (size_t i = 0; i < n; i++) mask[i] = column[i] > value; break;
+        case 5: for (size_t i = 0; i < n; i++) mask[i] = column[i] >= value; break;
+        default: break;
+        }
+    }
+
+    bool iequals(const std::string &a, const char *b)
+    {
+        return a.size() == std::strlen(b) && std::equal(a.begin(), a.end(), b,
+            [](char x, char y) { return std::toupper(x) == std::toupper(y); });
+    }
+
+    bool parse_kind(std::string text, double &kind)
+    {
+        for (auto prefix : { "REB_", "KIND_" }) {
+            if (text.size() > std::strlen(prefix) && iequals(text.substr(0, std::strlen(prefix)), prefix)) {
+                text = text.substr(std::strlen(prefix));
+            }
+        }
+        for (int slot = 0; slot < KIND_SLOT_COUNT; slot++) {
+            if (iequals(text, kind_names[slot])) {
+                kind = slot_kind(slot);
+                return true;
+            }
+        }
+        char *end = nullptr;
+        kind = std::strtod(text.c_str(), &end);
+        return !text.empty() && *end == '\0';
+    }
+
+    bool parse_number(const std::string &text, double &n)
+    {
+        char *end = nullptr;
+        n = std::strtod(text.c_str(), &end);
+        if (end == text.c_str()) return false;
+        switch (*end) {
+        case 'k': case 'K': n *= 1024; ++end; break;
+        case 'm': case 'M': n *= 1024 * 1024; ++end; break;
+        case 'g': case 'G': n *= 1024 * 1024 * 1024; ++end; break;
+        default: break;
+        }
+        if (*end == 'b' || *end == 'B') ++end;
+        return *end == '\0';
+    }
+}
+
+bool NodeFilter::parse(const std::string &expr)
+{
+    exprs.clear();
+    error.clear();
+    source = expr;
+    pos = 0;
+    root = parse_or();
+    skip_space();
+    if (root >= 0 && pos < source.size()) {
+        error = "unexpected '" + source.substr(pos) + "'";
+        root = -1;
+    }
+    return root >= 0;
+}
+
+void NodeFilter::skip_space()
+{
+    while (pos < source.size() && std::isspace(static_cast<unsigned char>(source[pos]))) ++pos;
+}
+
+bool NodeFilter::accept(const char *token)
+{
+    skip_space();
+    auto len = std::strlen(token);
+    if (source.compare(pos, len, token) == 0) {
+        pos += len;
+        return true;
+    }
+    return false;
+}
+
+std::string NodeFilter::word()
+{
+    skip_space();
+    std::string ret;
+    if (pos < source.size() && source[pos] == '"') {
+        auto end = source.find('"', pos + 1);
+        if (end == std::string::npos) {
+            error = "unterminated string";
+            pos = source.size();
+            return ret;
+        }
+        ret = source.substr(pos + 1, end - pos - 1);
+        pos = end + 1;
+        return ret;
+    }
+    while (pos < source.size()
+        && !std::isspace(static_cast<unsigned char>(source[pos]))
+        && !std::strchr("()&|", source[pos])) {
+        ret += source[pos++];
+    }
+    return ret;
+}
+
+int NodeFilter::add(const Expr &e)
+{
+    exprs.push_back(e);
+    return static_cast<int>(exprs.size()) - 1;
+}
+
+int NodeFilter::parse_or()
+{
+    int left = parse_and();
+    while (left >= 0 && accept("||")) {
+        int right = parse_and();
+        if (right < 0) return -1;
+        Expr e = { OP_OR, FIELD_KIND, 0, "", left, right };
+        left = add(e);
+    }
+    return left;
+}
+
+int NodeFilter::parse_and()
+{
+    int left = parse_unary();
+    while (left >= 0 && accept("&&")) {
+        int right = parse_unary();
+        if (right < 0) return -1;
+        Expr e = { OP_AND, FIELD_KIND, 0, "", left, right };
+        left = add(e);
+    }
+    return left;
+}
+
+int NodeFilter::parse_unary()
+{
+    if (accept("!") ) {
+        int operand = parse_unary();
+        if (operand < 0) return -1;
+        Expr e = { OP_NOT, FIELD_KIND, 0, "", operand, -1 };
+        return add(e);
+    }
+    if (accept("(")) {
+        int inner = parse_or();
+        if (inner < 0) return -1;
+        if (!accept(")")) {
+            error = "missing ')'";
+            return -1;
+        }
+        return inner;
+    }
+    return parse_predicate();
+}
+
+int NodeFilter::parse_predicate()
+{
+    skip_space();
+    std::string name;
+    while (pos < source.size() && (std::isalnum(static_cast<unsigned char>(source[pos])) || source[pos] == '_')) {
+        name += source[pos++];
+    }
+
+    Expr e = { OP_EQ, FIELD_KIND, 0, "", -1, -1 };
+    if (name == "kind" || name == "node_type") e.field = FIELD_KIND;
+    else if (name == "size") e.field = FIELD_SIZE;
+    else if (name == "subtree" || name == "subtree_size") e.field = FIELD_SUBTREE;
+    else if (name == "name") e.field = FIELD_NAME;
+    else if (name == "edge") e.field = FIELD_EDGE;
+    else if (name == "critical") e.field = FIELD_CRITICAL;
+    else if (name == "under") e.field = FIELD_UNDER;
+    else {
+        error = name.empty() ? "field expected at '" + source.substr(pos) + "'" : "unknown field '" + name + "'";
+        return -1;
+    }
+
+    const struct {
+        const char *token;
+        enum Op op;
+    } ops[] = {
+        { "==", OP_EQ }, { "!=", OP_NE }, { "<=", OP_LE }, { ">=", OP_GE },
+        { "=", OP_EQ }, { "<", OP_LT }, { ">", OP_GT }, { "~", OP_MATCH }
+    };
+    bool has_op = false;
+    for (const auto &o : ops) {
+        if (accept(o.token)) {
+            e.op = o.op;
+            has_op = true;
+            break;
+        }
+    }
+    if (!has_op) {
+        if (e.field != FIELD_CRITICAL) {
+            error = "operator expected after '" + name + "'";
+            return -1;
+        }
+        e.op = OP_NE; /* a bare `critical' */
+        return add(e);
+    }
+
+    e.text = word();
+    if (!error.empty()) return -1;
+    bool ok = true;
+    switch (e.field) {
+    case FIELD_KIND:
+        ok = e.op != OP_MATCH && parse_kind(e.text, e.number);
+        break;
+    case FIELD_SIZE:
+    case FIELD_SUBTREE:
+    case FIELD_CRITICAL:
+        ok = e.op != OP_MATCH && parse_number(e.text, e.number);
+        break;
+    case FIELD_NAME:
+    case FIELD_EDGE:
+        ok = e.op == OP_EQ || e.op == OP_NE || e.op == OP_MATCH;
+        break;
+    case FIELD_UNDER:
+        ok = e.op == OP_EQ;
+        break;
+    }
+    if (!ok) {
+        error = "invalid predicate on '" + name + "' with '" + e.text + "'";
+        return -1;
+    }
+    return add(e);
+}
+
+void NodeFilter::eval_string(const Expr &e, const std::vector<int> &ids, Mask &mask) const
+{
+    /* resolved once per string, then a lookup per node */
+    const auto &strings = StringBin::array;
+    Mask match(strings.size());
+    for (size_t i = 0; i < strings.size(); i++) {
+        match[i] = e.op == OP_MATCH ? strings[i].find(e.text) != std::string::npos : strings[i] == e.text;
+    }
+    const int n = static_cast<int>(match.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        mask[i] = ids[i] >= 0 && ids[i] < n && match[ids[i]];
+    }
+    if (e.op == OP_NE) {
+        for (auto &m : mask) m ^= 1;
+    }
+}
+
+void NodeFilter::eval_edge(const Expr &e, const Columns &columns, Mask &mask) const
+{
+    /* the edges a node is drawn with, i.e. those from its chosen parents */
+    std::vector<int> ids;
+    std::vector<uint32_t> targets;
+    for (auto node : columns.node) {
+        for (const auto &c : node->children) {
+            ids.push_back(c.edge.index());
+            targets.push_back(columns.index.at(c.node));
+        }
+    }
+    Mask edge_mask(ids.size());
+    Expr eq = e;
+    if (eq.op == OP_NE) eq.op = OP_EQ;
+    eval_string(eq, ids, edge_mask);
+
+    std::fill(mask.begin(), mask.end(), 0);
+    for (size_t i = 0; i < targets.size(); i++) {
+        mask[targets[i]] |= edge_mask[i];
+    }
+    if (e.op == OP_NE) {
+        for (auto &m : mask) m ^= 1;
+    }
+}
+
+void NodeFilter::eval_under(const Expr &e, MemoryDump &dump, const Columns &columns, Mask &mask) const
+{
+    std::fill(mask.begin(), mask.end(), 0);
+    std::vector<std::string> path;
+    size_t start = 0;
+    while (true) {
+        auto end = e.text.find(';', start);
+        path.push_back(e.text.substr(start, end - start));
+        if (end == std::string::npos) break;
+        start = end + 1;
+    }
+    Node *top = dump.find_node(path);
+    if (top == nullptr) {
+        std::cout << "No node found for path " << e.text << std::endl;
+        return;
+    }
+    std::vector<Node*> work(1, top);
+    while (!work.empty()) {
+        auto node = work.back();
+        work.pop_back();
+        for (const auto &c : node->children) {
+            auto &m = mask[columns.index.at(c.node)];
+            if (m) continue;
+            m = 1;
+            work.push_back(c.node);
+        }
+    }
+}
+
+void NodeFilter::eval(int expr, MemoryDump &dump, const Columns &columns, Mask &mask) const
+{
+    const auto &e = exprs[expr];
+    switch (e.op) {
+    case OP_AND:
+    case OP_OR:
+    {
+        Mask right(mask.size());
+        eval(e.left, dump, columns, mask);
+        eval(e.right, dump, columns, right);
+        if (e.op == OP_AND) {
+            for (size_t i = 0; i < mask.size(); i++) mask[i] &= right[i];
+        }
+        else {
+            for (size_t i = 0; i < mask.size(); i++) mask[i] |= right[i];
+        }
+        return;
+    }
+    case OP_NOT:
+        eval(e.left, dump, columns, mask);
+        for (auto &m : mask) m ^= 1;
+        return;
+    default:
+        break;
+    }
+
+    switch (e.field) {
+    case FIELD_KIND:
+        compare(columns.kind, e.op, e.number, mask);
+        break;
+    case FIELD_SIZE:
+        compare(columns.size, e.op, e.number, mask);
+        break;
+    case FIELD_SUBTREE:
+        compare(columns.subtree, e.op, e.number, mask);
+        break;
+    case FIELD_CRITICAL:
+        compare(columns.critical, e.op, e.number, mask);
+        break;
+    case FIELD_NAME:
+        eval_string(e, columns.name, mask);
+        break;
+    case FIELD_EDGE:
+        eval_edge(e, columns, mask);
+        break;
+    case FIELD_UNDER:
+        eval_under(e, dump, columns, mask);
+        break;
+    }
+}
+
+std::vector<Node*> NodeFilter::select(MemoryDump &dump) const
+{
+    std::vector<Node*> ret;
+    if (root < 0) return ret;
+
+    Columns columns;
+    const auto n = dump.nodes.size();
+    columns.node.reserve(n);
+    columns.kind.reserve(n);
+    columns.size.reserve(n);
+    columns.subtree.reserve(n);
+    columns.name.reserve(n);
+    columns.critical.reserve(n);
+    columns.index.reserve(n);
+    for (auto &&pair : dump.nodes) {
+        auto &node = pair.second;
+        columns.index[&node] = static_cast<uint32_t>(columns.node.size());
+        columns.node.push_back(&node);
+        columns.kind.push_back(node.node_type);
+        columns.size.push_back(node.size);
+        columns.subtree.push_back(node.subtree_size);
+        columns.name.push_back(node.name.index());
+        columns.critical.push_back(node.critical);
+    }
+
+    Mask mask(n);
+    eval(root, dump, columns, mask);
+    for (size_t i = 0; i < n; i++) {
+        if (mask[i] && columns.node[i]->label != 0) ret.push_back(columns.node[i]);
+    }
+    std::sort(ret.begin(), ret.end(), [](const Node *a, const Node *b) {
+        return a->subtree_size > b->subtree_size;
+    });
+    std::cout << ret.size() << " nodes match the filter" << std::endl;
+    return ret;
+}
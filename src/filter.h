@@ -0,0 +1,109 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_FILTER_H
+#define D2D_FILTER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+class MemoryDump;
+struct Node;
+
+/* --filter expressions, e.g.
+ *
+ *     kind=CHUNK && size>1M && under="NIL;system"
+ *     edge=<keeps> || (name~buffer && !critical)
+ *
+ * Fields are kind (node_type), size, subtree (subtree_size), name, edge,
+ * critical and under (a ';' separated path as -n takes). Numbers take k/M/G
+ * suffixes, `~' matches a substring. Every predicate is evaluated over a
+ * whole column at once and the results combined as byte masks */
+class NodeFilter {
+private:
+    enum Field {
+        FIELD_KIND,
+        FIELD_SIZE,
+        FIELD_SUBTREE,
+        FIELD_NAME,
+        FIELD_EDGE,
+        FIELD_CRITICAL,
+        FIELD_UNDER
+    };
+    enum Op {
+        OP_EQ,
+        OP_NE,
+        OP_LT,
+        OP_LE,
+        OP_GT,
+        OP_GE,
+        OP_MATCH,
+        OP_AND,
+        OP_OR,
+        OP_NOT
+    };
+    struct Expr {
+        enum Op op;
+        enum Field field;
+        double number;
+        std::string text;
+        int left;
+        int right;
+    };
+    struct Columns {
+        std::vector<Node*> node;
+        std::vector<int> kind;
+        std::vector<uint32_t> size;
+        std::vector<double> subtree;
+        std::vector<int> name;
+        std::vector<uint8_t> critical;
+        std::unordered_map<const Node*, uint32_t> index;
+    };
+    typedef std::vector<uint8_t> Mask;
+
+    std::vector<Expr> exprs;
+    int root;
+    std::string source;
+    size_t pos;
+    std::string error;
+
+    void skip_space();
+    bool accept(const char *token);
+    std::string word();
+    int parse_or();
+    int parse_and();
+    int parse_unary();
+    int parse_predicate();
+    int add(const Expr &e);
+
+    void eval(int expr, MemoryDump &dump, const Columns &columns, Mask &mask) const;
+    void eval_string(const Expr &e, const std::vector<int> &ids, Mask &mask) const;
+    void eval_edge(const Expr &e, const Columns &columns, Mask &mask) const;
+    void eval_under(const Expr &e, MemoryDump &dump, const Columns &columns, Mask &mask) const;
+public:
+    NodeFilter() : root(-1), pos(0) {}
+
+    bool parse(const std::string &expr);
+    const std::string &parse_error() const
+    {
+        return error;
+    }
+    std::vector<Node*> select(MemoryDump &dump) const;
+};
+
+#endif //D2D_FILTER_H
@@ -0,0 +1,295 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "cmd_parse.h"
+#include "dump.h"
+#include "export_tree.h"
+#include "group.h"
+
+namespace {
+    uint64_t mix(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    std::string string_of(int32_t id)
+    {
+        if (id < 0 || static_cast<size_t>(id) >= StringBin::array.size()) return "";
+        return StringBin::array[id];
+    }
+}
+
+GroupBy::GroupBy()
+    : fields(0),
+    path_depth(0)
+{
+}
+
+bool GroupBy::parse(const std::string &text)
+{
+    fields = 0;
+    path_depth = 0;
+    std::stringstream ss(text);
+    std::string field;
+    while (std::getline(ss, field, ',')) {
+        field.erase(0, field.find_first_not_of(" \t"));
+        field.erase(field.find_last_not_of(" \t") + 1);
+        if (field == "kind") {
+            fields |= KEY_KIND;
+        }
+        else if (field == "edge") {
+            fields |= KEY_EDGE;
+        }
+        else if (field == "name") {
+            fields |= KEY_NAME;
+        }
+        else if (field.compare(0, 4, "path") == 0 && (field.size() == 4 || field[4] == ':')) {
+            fields |= KEY_PATH;
+            if (field.size() > 4) {
+                char *end = nullptr;
+                path_depth = static_cast<int>(std::strtol(field.c_str() + 5, &end, 10));
+                if (end == field.c_str() + 5 || *end != '\0' || path_depth <= 0) {
+                    error = "bad path depth in '" + field + "'";
+                    return false;
+                }
+            }
+        }
+        else {
+            error = "unknown key '" + field + "', expected kind, edge, name or path[:N]";
+            return false;
+        }
+    }
+    if (fields == 0) {
+        error = "no key";
+        return false;
+    }
+    return true;
+}
+
+void GroupBy::grow()
+{
+    std::vector<uint32_t> old(slots.size() * 2, 0);
+    old.swap(slots);
+    size_t mask = slots.size() - 1;
+    for (uint32_t g = 0; g < groups.size(); g++) {
+        size_t i = groups[g].hash & mask;
+        while (slots[i] != 0) i = (i + 1) & mask;
+        slots[i] = g + 1;
+    }
+}
+
+uint32_t GroupBy::find_or_add(const std::vector<int32_t> &key, const Node &node)
+{
+    uint64_t hash = key.size();
+    for (auto k : key) {
+        hash = mix(hash ^ static_cast<uint32_t>(k)) + 0x9e3779b97f4a7c15ULL;
+    }
+    if ((groups.size() + 1) * 10 > slots.size() * 7) grow();
+
+    /* linear probing, the slots are a power of two */
+    size_t mask = slots.size() - 1;
+    size_t i = hash & mask;
+    while (slots[i] != 0) {
+        const auto &g = groups[slots[i] - 1];
+        if (g.hash == hash && g.key_size == key.size()
+            && std::equal(key.begin(), key.end(), keys.begin() + g.key)) {
+            return slots[i] - 1;
+        }
+        i = (i + 1) & mask;
+    }
+    Group g = { hash, static_cast<uint32_t>(keys.size()), static_cast<uint32_t>(key.size()), node.node_type, 0, 0, 0 };
+    keys.insert(keys.end(), key.begin(), key.end());
+    groups.push_back(g);
+    slots[i] = static_cast<uint32_t>(groups.size());
+    return static_cast<uint32_t>(groups.size() - 1);
+}
+
+void GroupBy::run(MemoryDump &dump, const std::vector<Node*> &roots)
+{
+    groups.clear();
+    keys.clear();
+    links.clear();
+    slots.assign(1 << 10, 0);
+
+    const uint32_t NO_GROUP = UINT32_MAX;
+    struct Frame {
+        Node *node;
+        const ChildNode *edge; /* nullptr for the roots */
+        uint32_t parent;
+        size_t depth; /* of the parent's path */
+    };
+    std::vector<Frame> stack;
+    std::vector<int32_t> path;
+    std::vector<int32_t> key;
+    for (auto it = roots.rbegin(); it != roots.rend(); ++it) {
+        if ((*it)->visited >= 0) continue;
+        (*it)->visited = 1;
+        stack.push_back({ *it, nullptr, NO_GROUP, 0 });
+    }
+    while (!stack.empty()) {
+        auto f = stack.back();
+        stack.pop_back();
+        auto &node = *f.node;
+        path.resize(f.depth);
+        path.push_back(node.name.index());
+
+        key.clear();
+        if (fields & KEY_KIND) key.push_back(node.node_type);
+        if (fields & KEY_EDGE) key.push_back(f.edge == nullptr ? -1 : f.edge->edge.index());
+        if (fields & KEY_NAME) key.push_back(node.name.index());
+        if (fields & KEY_PATH) {
+            size_t start = path_depth > 0 && path.size() > static_cast<size_t>(path_depth) ? path.size() - path_depth : 0;
+            key.push_back(start > 0);
+            key.insert(key.end(), path.begin() + start, path.end());
+        }
+        auto g = find_or_add(key, node);
+        auto &group = groups[g];
+        group.count++;
+        group.self += node.size;
+        group.subtree += node.subtree_size;
+        if (f.parent != NO_GROUP && f.parent != g) {
+            links.push_back(static_cast<uint64_t>(f.parent) << 32 | g);
+        }
+
+        for (auto c = node.children.rbegin(); c != node.children.rend(); ++c) {
+            if (c->node->visited >= 0) continue;
+            c->node->visited = 1;
+            stack.push_back({ c->node, &*c, g, path.size() });
+        }
+    }
+    dump.clear_visited();
+
+    std::sort(links.begin(), links.end());
+    links.erase(std::unique(links.begin(), links.end()), links.end());
+}
+
+std::string GroupBy::key_text(const Group &g) const
+{
+    std::string ret;
+    auto k = keys.begin() + g.key;
+    auto end = k + g.key_size;
+    auto add = [&ret](const std::string &s) {
+        if (!ret.empty()) ret += ' ';
+        ret += s;
+    };
+    if (fields & KEY_KIND) add(kind_name(*k++));
+    if (fields & KEY_EDGE) {
+        auto edge = string_of(*k++);
+        add(edge.empty() ? "-" : edge);
+    }
+    if (fields & KEY_NAME) add(string_of(*k++));
+    if (fields & KEY_PATH) {
+        std::string path = *k++ ? "*;" : ""; /* cut to the last path_depth names */
+        for (bool first = true; k != end; ++k, first = false) {
+            path += (first ? "" : ";") + string_of(*k);
+        }
+        add(path);
+    }
+    return ret;
+}
+
+std::vector<uint32_t> GroupBy::sorted() const
+{
+    std::vector<uint32_t> order(groups.size());
+    for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return groups[a].subtree > groups[b].subtree;
+    });
+    return order;
+}
+
+void GroupBy::write_graph(MemoryDump &dump, std::ofstream &ofile, const cmd_opt &opt)
+{
+    dump.make_exporter(opt);
+    dump.exporter->write_preamble(ofile);
+    std::vector<Node*> nodes(groups.size(), nullptr);
+    for (auto i : sorted()) {
+        const auto &g = groups[i];
+        if (g.subtree < dump.min_size) continue;
+        auto name = key_text(g) + " (" + std::to_string(g.count) + "x)";
+        nodes[i] = dump.coarse_node(name, g.self, g.kind);
+        nodes[i]->subtree_size = g.subtree;
+        dump.write_node(*nodes[i], ofile, opt);
+    }
+    for (auto l : links) {
+        auto from = nodes[l >> 32], to = nodes[l & 0xFFFFFFFF];
+        if (from != nullptr && to != nullptr) {
+            dump.write_edge(*from, *to, ofile, "");
+        }
+    }
+    dump.exporter->write_appendix(ofile);
+    dump.coarse_nodes.clear();
+}
+
+void GroupBy::write_text(std::ostream &os, double total) const
+{
+    os << std::right << std::setw(12) << "count" << std::setw(16) << "self"
+        << std::setw(16) << "subtree" << std::setw(9) << "%" << "  key" << std::endl;
+    for (auto i : sorted()) {
+        const auto &g = groups[i];
+        os << std::setw(12) << g.count
+            << std::setw(16) << static_cast<uint64_t>(g.self)
+            << std::setw(16) << static_cast<uint64_t>(g.subtree)
+            << std::setw(8) << std::fixed << std::setprecision(2) << (total > 0 ? 100 * g.subtree / total : 0) << "%"
+            << std::defaultfloat << "  " << key_text(g) << std::endl;
+    }
+}
+
+void GroupBy::write_json(std::ostream &os, double total) const
+{
+    os << "{\n  \"total_bytes\": " << static_cast<uint64_t>(total) << ",\n  \"groups\": [";
+    bool first = true;
+    for (auto i : sorted()) {
+        const auto &g = groups[i];
+        os << (first ? "\n" : ",\n") << "    {\"key\": ";
+        write_json_string(key_text(g), os);
+        os << ", \"count\": " << g.count
+            << ", \"self\": " << static_cast<uint64_t>(g.self)
+            << ", \"subtree\": " << static_cast<uint64_t>(g.subtree) << "}";
+        first = false;
+    }
+    os << "\n  ]\n}\n";
+}
+
+bool GroupBy::write_report(const std::string &path, double total) const
+{
+    bool json = path.size() > 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    if (path == "-") {
+        write_text(std::cout, total);
+        return true;
+    }
+    std::ofstream fo(path, std::ofstream::trunc);
+    if (json) {
+        write_json(fo, total);
+    }
+    else {
+        write_text(fo, total);
+    }
+    if (!fo.good()) {
+        std::cout << "Failed to write the group report to " << path << std::endl;
+        return false;
+    }
+    std::cout << groups.size() << " groups written to " << path << std::endl;
+    return true;
+}
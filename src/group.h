@@ -0,0 +1,96 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_GROUP_H
+#define D2D_GROUP_H
+
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "kind.h"
+
+struct Node;
+class MemoryDump;
+class cmd_opt;
+
+/* --group-by: count, self size and subtree size of the nodes summed up by
+ * a key made of any of
+ *
+ *     kind        the node's kind
+ *     edge        the name of the edge it is kept by
+ *     name        its own name
+ *     path[:N]    the names from the root down to it, the last N only if given
+ *
+ * e.g. "path:2,edge". The graph is walked once from the selected roots,
+ * every node counting once, where it is first reached; nested members of a
+ * group add their subtree each time. The groups live in an open addressing
+ * hash table, keys are runs of ints in one pool.
+ *
+ * The export becomes the graph of the groups, one edge per pair of groups
+ * a node and its child fall into, and --group-report FILE lists them,
+ * biggest subtree first */
+class GroupBy {
+private:
+    enum {
+        KEY_KIND = 1,
+        KEY_EDGE = 2,
+        KEY_NAME = 4,
+        KEY_PATH = 8
+    };
+    struct Group {
+        uint64_t hash;
+        uint32_t key; /* offset into keys */
+        uint32_t key_size;
+        enum Reb_Kind kind; /* of the first member */
+        uint64_t count;
+        double self;
+        double subtree;
+    };
+
+    int fields;
+    int path_depth; /* 0 for the whole path */
+    std::string error;
+
+    std::vector<int32_t> keys;
+    std::vector<Group> groups;
+    std::vector<uint32_t> slots; /* group + 1, 0 if empty */
+    std::vector<uint64_t> links; /* parent group << 32 | child group */
+
+    uint32_t find_or_add(const std::vector<int32_t> &key, const Node &node);
+    void grow();
+    std::string key_text(const Group &g) const;
+    std::vector<uint32_t> sorted() const;
+public:
+    GroupBy();
+
+    bool parse(const std::string &text);
+    const std::string &parse_error() const
+    {
+        return error;
+    }
+
+    void run(MemoryDump &dump, const std::vector<Node*> &roots);
+    void write_graph(MemoryDump &dump, std::ofstream &ofile, const cmd_opt &opt);
+    void write_text(std::ostream &os, double total) const;
+    void write_json(std::ostream &os, double total) const;
+    /* as JSON when the name ends in .json, "-" for stdout */
+    bool write_report(const std::string &path, double total) const;
+};
+
+#endif //D2D_GROUP_H
@@ -45,6 +45,8 @@ extern "C" {
             std::cout << "Failed to parse the input" << std::endl;
         }
         app->dump.update_subtree_size();
+        /* every export after this one only walks what it shows */
+        app->dump.build_levels();
         app->imported = true;
         std::cout << "imported from '" << app->opt.ifile << "'" << std::endl;
     }
@@ -0,0 +1,360 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#include <iostream>
+#include <deque>
+#include <unordered_set>
+#include <sys/stat.h>
+
+#include "cmd_parse.h"
+#include "dump.h"
+#include "index.h"
+
+namespace {
+    const uint64_t INDEX_MAGIC = 0x49443244; /* "D2DI" */
+    const uint64_t INDEX_VERSION = 1;
+    const size_t INDEX_HEADER = 3;
+
+    struct EntryLess {
+        bool operator () (const DumpIndex::IndexEntry &a, const DumpIndex::IndexEntry &b) const {
+            return a.key < b.key || (a.key == b.key && a.offset < b.offset);
+        }
+    };
+
+    bool stat_file(const std::string &path, uint64_t &size, uint64_t &mtime)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) return false;
+        size = static_cast<uint64_t>(st.st_size);
+        mtime = static_cast<uint64_t>(st.st_mtime);
+        return true;
+    }
+}
+
+bool DumpIndex::open(const std::string &path, size_t memory_budget)
+{
+    dump_path = path;
+    dump.open(path, std::ifstream::binary);
+    if (!dump.good()) {
+        std::cout << "Failed to open " << path << std::endl;
+        return false;
+    }
+    auto index_path = path + ".idx";
+    if (open_index(index_path)) {
+        std::cout << "Using index " << index_path << std::endl;
+        return true;
+    }
+    return build(index_path, memory_budget) && open_index(index_path);
+}
+
+bool DumpIndex::open_index(const std::string &index_path)
+{
+    uint64_t size, mtime;
+    if (!stat_file(dump_path, size, mtime)) return false;
+    if (!entries.map(index_path) || entries.size() < INDEX_HEADER) return false;
+    if (entries[0].key != INDEX_MAGIC || entries[0].offset != INDEX_VERSION
+        || entries[1].key != size || entries[1].offset != mtime
+        || INDEX_HEADER + entries[2].key + entries[2].offset != entries.size()) {
+        std::cout << "Index " << index_path << " is stale" << std::endl;
+        entries.unmap();
+        return false;
+    }
+    own_begin = INDEX_HEADER;
+    own_end = parent_begin = own_begin + entries[2].key;
+    parent_end = entries.size();
+    return true;
+}
+
+bool DumpIndex::build(const std::string &index_path, size_t memory_budget)
+{
+    std::cout << "Building index " << index_path << std::endl;
+    uint64_t size, mtime;
+    if (!stat_file(dump_path, size, mtime)) return false;
+
+    auto budget = memory_budget > 0 ? memory_budget / 2 : 128 << 20;
+    ExternalSorter<IndexEntry, EntryLess> own(index_path + "-own", budget);
+    ExternalSorter<IndexEntry, EntryLess> parents(index_path + "-parent", budget);
+
+    std::ifstream fi(dump_path, std::ifstream::binary);
+    std::string line;
+    uint64_t offset = 0;
+    size_t i = 0;
+    DumpRecord rec;
+    while (std::getline(fi, line)) {
+        ++i;
+        Parse_Result parse_result;
+        try {
+            parse_result = parse_record(line.c_str(), rec);
+        }
+        catch (...) {
+            parse_result = PARSE_FAIL;
+        }
+        if (parse_result == PARSE_OK) {
+            own.push({ rec.label, offset });
+            parents.push({ rec.parent, offset });
+        }
+        else if (parse_result == PARSE_FAIL) {
+            std::cout << "Failed to parse line " << i << ": " << line << std::endl;
+        }
+        offset += line.size() + 1;
+    }
+
+    auto own_path = index_path + "-own.bin";
+    auto parent_path = index_path + "-parent.bin";
+    auto own_count = own.finish(own_path);
+    auto parent_count = parents.finish(parent_path);
+
+    {
+        RecordWriter<IndexEntry> w(index_path);
+        if (!w.good()) {
+            std::cout << "Failed to write " << index_path << std::endl;
+            return false;
+        }
+        w.push({ INDEX_MAGIC, INDEX_VERSION });
+        w.push({ size, mtime });
+        w.push({ own_count, parent_count });
+        IndexEntry e;
+        RecordReader<IndexEntry> r1(own_path);
+        while (r1.next(e)) w.push(e);
+        RecordReader<IndexEntry> r2(parent_path);
+        while (r2.next(e)) w.push(e);
+    }
+    std::remove(own_path.c_str());
+    std::remove(parent_path.c_str());
+    std::cout << i << " lines indexed" << std::endl;
+    return true;
+}
+
+void DumpIndex::find(size_t begin, size_t end, uintptr_t key, std::vector<uint64_t> &offsets) const
+{
+    offsets.clear();
+    auto lo = begin, hi = end;
+    while (lo < hi) {
+        auto mid = lo + (hi - lo) / 2;
+        if (entries[mid].key < key) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    for (auto i = lo; i < end && entries[i].key == key; i++) {
+        offsets.push_back(entries[i].offset);
+    }
+}
+
+bool DumpIndex::read(uint64_t offset, DumpRecord &rec)
+{
+    std::string line;
+    dump.clear();
+    dump.seekg(offset);
+    if (!std::getline(dump, line)) return false;
+    try {
+        return parse_record(line.c_str(), rec) == PARSE_OK;
+    }
+    catch (...) {
+        return false;
+    }
+}
+
+const DumpIndex::ParentInfo &DumpIndex::parent(uintptr_t label)
+{
+    auto iter = parent_info.find(label);
+    if (iter != parent_info.end()) return iter->second;
+
+    auto &info = parent_info[label];
+    info.exists = label == 0; /* NIL */
+    info.self = false;
+    std::vector<uint64_t> offsets;
+    find(own_begin, own_end, label, offsets);
+    DumpRecord rec;
+    if (!offsets.empty() && read(offsets.front(), rec)) {
+        info.exists = true;
+        info.self = rec.has_name && (rec.name == "self" || rec.name == "???");
+    }
+    return info;
+}
+
+/* the edge selection of MemoryDump::link_node, with the parents looked up in the index */
+size_t DumpIndex::choose_parents(const Node &node, std::vector<const ParentNode*> &chosen)
+{
+    chosen.clear();
+    enum EdgePriority priority = EDGE_PRIORITY_MIN;
+    for (const auto & p : node.parents) {
+        const auto &info = parent(p.label);
+        bool skip = info.exists && info.self; // always keep the edges from self and ??? to its context
+        if (p.priority > priority && !skip) {
+            priority = p.priority;
+        }
+    }
+    for (const auto & p : node.parents) {
+        if (p.priority >= priority && parent(p.label).exists) {
+            chosen.push_back(&p);
+        }
+    }
+    return chosen.size();
+}
+
+bool DumpIndex::load_node(uintptr_t label, MemoryDump &dump)
+{
+    if (dump.nodes.find(label) != dump.nodes.end()) return true;
+
+    std::vector<uint64_t> offsets;
+    find(own_begin, own_end, label, offsets);
+    if (offsets.empty()) {
+        if (label != 0) return false;
+        dump.nodes[0] = Node(0, "NIL"); /* the synthetic top node import() inserts */
+        return true;
+    }
+
+    Node *node = nullptr;
+    DumpRecord rec;
+    for (auto offset : offsets) {
+        if (!read(offset, rec)) continue;
+        if (node == nullptr) {
+            node = &dump.nodes[label];
+            node->label = rec.label;
+            node->node_type = rec.kind;
+            node->subtree_size = node->size = rec.size;
+            if (rec.has_name) {
+                node->name.str(rec.name);
+            }
+            else {
+                node->name.erase();
+            }
+        }
+        node->parents.insert(ParentNode(rec.parent, rec.edge));
+    }
+    return node != nullptr;
+}
+
+std::vector<uintptr_t> DumpIndex::query(MemoryDump &dump, const cmd_opt &opt)
+{
+    dump.reset();
+    std::vector<uintptr_t> roots;
+    std::vector<uint64_t> offsets;
+    std::vector<const ParentNode*> chosen;
+    DumpRecord rec;
+
+    /* the labels of the nodes having `label' as one of their chosen parents */
+    auto children_of = [&](uintptr_t label, std::vector<std::pair<uintptr_t, const ParentNode*>> &children) {
+        children.clear();
+        find(parent_begin, parent_end, label, offsets);
+        std::unordered_set<uintptr_t> seen;
+        for (auto offset : offsets) {
+            if (!read(offset, rec) || !seen.insert(rec.label).second) continue;
+            if (!load_node(rec.label, dump)) continue;
+            const auto &child = dump.nodes[rec.label];
+            choose_parents(child, chosen);
+            for (auto p : chosen) {
+                if (p->label == label) {
+                    children.push_back(std::make_pair(rec.label, p));
+                    break;
+                }
+            }
+        }
+    };
+
+    std::vector<std::pair<uintptr_t, const ParentNode*>> children;
+    for (const auto &path : opt.nodes) {
+        /* paths start at a top node, of which only NIL can be found through the index */
+        uintptr_t current = 0;
+        bool found = !path.node.empty() && path.node.front() == "NIL" && load_node(0, dump);
+        for (size_t i = 1; found && i < path.node.size(); i++) {
+            const auto &name = path.node[i];
+            found = false;
+            children_of(current, children);
+            for (const auto & c : children) {
+                if (dump.nodes[c.first].name.str() == name) {
+                    current = c.first;
+                    found = true;
+                    break;
+                }
+            }
+        }
+        if (found) {
+            roots.push_back(current);
+        }
+        else {
+            std::cout << "No node found for path " << path.literal << std::endl;
+        }
+    }
+
+    for (auto label : opt.labels) {
+        if (load_node(label, dump)) {
+            roots.push_back(label);
+        }
+        else {
+            std::cout << "Label " << std::hex << label << std::dec << " was not found\n";
+        }
+    }
+
+    /* breadth first from the roots, reading only the records we reach */
+    std::unordered_set<uintptr_t> expanded;
+    std::deque<uintptr_t> queue(roots.begin(), roots.end());
+    while (!queue.empty()) {
+        auto label = queue.front();
+        queue.pop_front();
+        if (!expanded.insert(label).second) continue;
+        children_of(label, children);
+        auto &node = dump.nodes[label];
+        for (const auto & c : children) {
+            node.children.push_back(ChildNode(&dump.nodes[c.first], c.second->edge));
+            if (expanded.find(c.first) == expanded.end()) {
+                queue.push_back(c.first);
+            }
+        }
+    }
+    std::cout << expanded.size() << " nodes read through the index" << std::endl;
+
+    /* the divisions by the rule of pre_update_subtree_size(), as under the
+     * top node of a full import. A chosen parent outside the subgraph counts:
+     * it is not below the node, so its edge cannot close a cycle. The edges
+     * within the subgraph are counted from the roots, but for those back to
+     * a node on the path */
+    for (auto label : expanded) {
+        auto &node = dump.nodes[label];
+        choose_parents(node, chosen);
+        node.subtree_size_division = 0;
+        for (auto p : chosen) {
+            if (expanded.find(p->label) == expanded.end()) ++node.subtree_size_division;
+        }
+    }
+    for (auto label : roots) {
+        auto &node = dump.nodes[label];
+        dump.top_nodes.push_back(ChildNode(&node, ""));
+        std::set<uintptr_t> path;
+        dump.pre_update_subtree_size(node, path);
+        --node.subtree_size_division; /* the root is not its own parent */
+    }
+    dump.clear_visited();
+    for (auto label : roots) {
+        auto &node = dump.nodes[label];
+        node.subtree_size_division = std::max<short>(node.subtree_size_division, 1);
+    }
+
+    dump.total_size = 0;
+    for (auto label : roots) {
+        auto &node = dump.nodes[label];
+        std::set<uintptr_t> path;
+        dump.update_subtree_size(node, path);
+        dump.total_size += node.subtree_size;
+    }
+    dump.clear_visited();
+    dump.set_critical(dump.top_nodes);
+    dump.clear_visited();
+    return roots;
+}
@@ -0,0 +1,80 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_INDEX_H
+#define D2D_INDEX_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <unordered_map>
+
+#include "external.h"
+
+class MemoryDump;
+class cmd_opt;
+struct DumpRecord;
+struct Node;
+struct ParentNode;
+
+/* Byte offsets of the records of every label, and of the records naming
+ * it as parent, kept in "<dump>.idx" so that a subtree can be read
+ * without importing the whole dump.
+ *
+ * The file is an array of IndexEntry: three header entries, then the
+ * entries keyed by label, then the ones keyed by parent label, each
+ * sorted by key */
+class DumpIndex {
+public:
+    struct IndexEntry {
+        uint64_t key;
+        uint64_t offset;
+    };
+
+private:
+    struct ParentInfo {
+        bool exists;
+        bool self; /* named "self" or "???" */
+    };
+
+    std::string dump_path;
+    std::ifstream dump;
+    MappedArray<IndexEntry> entries;
+    size_t own_begin, own_end;
+    size_t parent_begin, parent_end;
+    std::unordered_map<uintptr_t, ParentInfo> parent_info;
+
+    bool open_index(const std::string &index_path);
+    bool build(const std::string &index_path, size_t memory_budget);
+    void find(size_t begin, size_t end, uintptr_t key, std::vector<uint64_t> &offsets) const;
+    bool read(uint64_t offset, DumpRecord &rec);
+    bool load_node(uintptr_t label, MemoryDump &dump);
+    const ParentInfo &parent(uintptr_t label);
+    size_t choose_parents(const Node &node, std::vector<const ParentNode*> &chosen);
+public:
+    DumpIndex()
+        : own_begin(0), own_end(0),
+        parent_begin(0), parent_end(0)
+    {}
+
+    /* use "<path>.idx", (re)building it if it is missing or older than the dump */
+    bool open(const std::string &path, size_t memory_budget);
+
+    /* load only what is reachable from opt.nodes and opt.labels, returns the roots found */
+    std::vector<uintptr_t> query(MemoryDump &dump, const cmd_opt &opt);
+};
+
+#endif //D2D_INDEX_H
@@ -17,6 +17,7 @@
 #include "kind.h"
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 std::unordered_map<int, std::string> kind2str = {
     {REB_TRASH, "TRASH"},
@@ -90,3 +91,18 @@ std::unordered_map<int, std::string> kind2str = {
     {GOBT_TEXT, "ARRAY(TEXT)" },
     {GOBT_EFFECT, "ARRAY(EFFECT)" }
 };
+
+namespace {
+    std::vector<const char*> slot_names()
+    {
+        std::vector<const char*> names(KIND_SLOT_COUNT, "???");
+        for (const auto &pair : kind2str) {
+            int slot = kind_slot(pair.first);
+            if (slot >= 0) names[slot] = pair.second.c_str();
+        }
+        return names;
+    }
+}
+
+/* kind2str by kind_slot(), built after it in this file */
+const std::vector<const char*> kind_names = slot_names();
@@ -19,6 +19,7 @@
 
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 /***********************************************************************
 **
@@ -104,4 +105,29 @@
 };
 
 extern std::unordered_map<int, std::string> kind2str;
+
+/* dense index of every kind: REB_* step by 4 below REB_MAX, the rest by 1 */
+const int KIND_SLOT_COUNT = REB_MAX / 4 + (GOBT_EFFECT - REB_KIND_SERIES + 1);
+
+inline int kind_slot(int kind)
+{
+    if (kind >= 0 && kind < REB_MAX) return kind % 4 == 0 ? kind / 4 : -1;
+    if (kind >= REB_KIND_SERIES && kind <= GOBT_EFFECT) return REB_MAX / 4 + kind - REB_KIND_SERIES;
+    return -1;
+}
+
+inline int slot_kind(int slot)
+{
+    return slot < REB_MAX / 4 ? slot * 4 : slot - REB_MAX / 4 + REB_KIND_SERIES;
+}
+
+/* the names of kind2str by kind_slot() */
+extern const std::vector<const char*> kind_names;
+
+/* a table lookup, unlike kind2str */
+inline const char *kind_name(int kind)
+{
+    int slot = kind_slot(kind);
+    return slot < 0 ? "???" : kind_names[slot];
+}
 #endif //D2D_KIND_H
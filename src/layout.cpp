@@ -0,0 +1,324 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "cmd_parse.h"
+#include "dump.h"
+#include "kind.h"
+#include "layout.h"
+
+namespace {
+    struct KindLayout {
+        uint64_t count;
+        uint64_t bytes;
+        uint64_t pages; /* distinct pages objects of the kind start in */
+        uint64_t runs; /* of neighbours of the same kind */
+        uint64_t last_page;
+        double stride; /* sum of the distances between neighbours of the kind */
+        uint64_t last_address;
+    };
+
+    struct Layout {
+        uint64_t objects;
+        uint64_t bytes;
+        uint64_t begin;
+        uint64_t end;
+        uint64_t gaps;
+        uint64_t gap_bytes;
+        uint64_t largest_gap;
+        uint64_t gap_histogram[64]; /* by log2 of the gap */
+        uint64_t overlaps;
+        uint64_t page_size;
+        uint64_t pages;
+        uint64_t page_bytes;
+        uint64_t sparse_pages; /* less than a quarter full */
+        uint64_t fill_histogram[10]; /* by tenth of the page filled */
+        std::vector<KindLayout> kinds; /* by kind_slot(), the last one for unknown kinds */
+        std::vector<std::pair<uint64_t, uint64_t>> page_fill; /* for the heatmap */
+    };
+
+    int log2_floor(uint64_t n)
+    {
+        int r = 0;
+        while (n >>= 1) ++r;
+        return r;
+    }
+
+    void analyze(const std::vector<LayoutReport::Object> &objects, uint64_t page_size, bool keep_pages, Layout &l)
+    {
+        std::memset(l.gap_histogram, 0, sizeof(l.gap_histogram));
+        std::memset(l.fill_histogram, 0, sizeof(l.fill_histogram));
+        l.objects = objects.size();
+        l.bytes = l.begin = l.end = 0;
+        l.gaps = l.gap_bytes = l.largest_gap = l.overlaps = 0;
+        l.page_size = page_size;
+        l.pages = l.page_bytes = l.sparse_pages = 0;
+        KindLayout zero = { 0, 0, 0, 0, UINT64_MAX, 0, 0 };
+        l.kinds.assign(KIND_SLOT_COUNT + 1, zero);
+        if (objects.empty()) return;
+
+        /* the pages an object reaches past the one being filled wait in `pending' */
+        std::deque<uint64_t> pending;
+        uint64_t base_page = objects.front().address / page_size;
+        auto emit = [&](uint64_t page, uint64_t bytes) {
+            if (bytes == 0) return;
+            bytes = std::min(bytes, page_size);
+            ++l.pages;
+            l.page_bytes += bytes;
+            if (bytes * 4 < page_size) ++l.sparse_pages;
+            ++l.fill_histogram[std::min<uint64_t>(9, bytes * 10 / page_size)];
+            if (keep_pages) l.page_fill.push_back(std::make_pair(page, bytes));
+        };
+
+        l.begin = objects.front().address;
+        uint64_t end = l.begin;
+        int last_kind = -1;
+        for (const auto &o : objects) {
+            l.bytes += o.size;
+            if (o.address > end) {
+                uint64_t gap = o.address - end;
+                ++l.gaps;
+                l.gap_bytes += gap;
+                l.largest_gap = std::max(l.largest_gap, gap);
+                ++l.gap_histogram[log2_floor(gap)];
+            }
+            else if (o.address < end) {
+                ++l.overlaps;
+            }
+            end = std::max(end, o.address + o.size);
+
+            uint64_t first = o.address / page_size;
+            uint64_t last = (o.address + std::max<uint32_t>(o.size, 1) - 1) / page_size;
+            while (base_page < first && !pending.empty()) {
+                emit(base_page++, pending.front());
+                pending.pop_front();
+            }
+            if (pending.empty()) base_page = first;
+            if (pending.size() < last - base_page + 1) pending.resize(last - base_page + 1, 0);
+            for (uint64_t p = first; p <= last; p++) {
+                uint64_t from = std::max(o.address, p * page_size);
+                uint64_t to = std::min(o.address + o.size, (p + 1) * page_size);
+                pending[p - base_page] += to > from ? to - from : 0;
+            }
+
+            int slot = kind_slot(o.kind);
+            auto &k = l.kinds[slot < 0 ? KIND_SLOT_COUNT : slot];
+            if (k.count > 0) k.stride += static_cast<double>(o.address - k.last_address);
+            ++k.count;
+            k.bytes += o.size;
+            if (k.last_page != first) ++k.pages;
+            k.last_page = first;
+            k.last_address = o.address;
+            if (slot != last_kind) ++k.runs;
+            last_kind = slot;
+        }
+        while (!pending.empty()) {
+            emit(base_page++, pending.front());
+            pending.pop_front();
+        }
+        l.end = end;
+    }
+
+    const char *slot_name(size_t slot)
+    {
+        return slot < static_cast<size_t>(KIND_SLOT_COUNT) ? kind_names[slot] : "???";
+    }
+
+    double percent(double a, double b)
+    {
+        return b > 0 ? 100 * a / b : 0;
+    }
+
+    void write_text(const Layout &l, std::ostream &os)
+    {
+        uint64_t span = l.end - l.begin;
+        os << l.objects << " objects, " << l.bytes << " bytes in 0x" << std::hex << l.begin
+            << " - 0x" << l.end << std::dec << " (" << span << " bytes, "
+            << std::fixed << std::setprecision(2) << percent(l.bytes, span) << "% used)" << std::endl
+            << l.gaps << " gaps, " << l.gap_bytes << " bytes, the largest " << l.largest_gap << " bytes; "
+            << l.overlaps << " overlapping objects" << std::endl;
+        os << "Gaps by size:" << std::endl;
+        for (int i = 0; i < 64; i++) {
+            if (l.gap_histogram[i] == 0) continue;
+            os << "  >= " << std::setw(12) << (uint64_t(1) << i) << std::setw(12) << l.gap_histogram[i] << std::endl;
+        }
+        os << l.pages << " pages of " << l.page_size << " bytes touched, "
+            << percent(l.page_bytes, static_cast<double>(l.pages) * l.page_size) << "% filled on average, "
+            << l.sparse_pages << " less than a quarter full, fragmentation "
+            << 100 - percent(l.page_bytes, static_cast<double>(l.pages) * l.page_size) << "%" << std::endl;
+        os << "Pages by fill:" << std::endl;
+        for (int i = 0; i < 10; i++) {
+            os << "  " << std::setw(3) << i * 10 << "-" << std::setw(3) << (i + 1) * 10 << "%"
+                << std::setw(12) << l.fill_histogram[i] << std::endl;
+        }
+        os << "By kind:" << std::endl
+            << std::left << std::setw(16) << "  kind" << std::right << std::setw(12) << "count" << std::setw(16) << "bytes"
+            << std::setw(12) << "pages" << std::setw(10) << "density" << std::setw(10) << "run" << std::setw(16) << "stride" << std::endl;
+        for (size_t i = 0; i < l.kinds.size(); i++) {
+            const auto &k = l.kinds[i];
+            if (k.count == 0) continue;
+            os << "  " << std::left << std::setw(14) << slot_name(i) << std::right
+                << std::setw(12) << k.count << std::setw(16) << k.bytes << std::setw(12) << k.pages
+                << std::setw(9) << percent(k.bytes, static_cast<double>(k.pages) * l.page_size) << "%"
+                << std::setw(10) << static_cast<double>(k.count) / k.runs
+                << std::setw(16) << (k.count > 1 ? k.stride / (k.count - 1) : 0) << std::endl;
+        }
+        os << std::defaultfloat;
+    }
+
+    void write_json(const Layout &l, std::ostream &os)
+    {
+        os << "{\n  \"objects\": " << l.objects << ", \"bytes\": " << l.bytes
+            << ", \"begin\": " << l.begin << ", \"end\": " << l.end
+            << ",\n  \"gaps\": " << l.gaps << ", \"gap_bytes\": " << l.gap_bytes
+            << ", \"largest_gap\": " << l.largest_gap << ", \"overlaps\": " << l.overlaps
+            << ",\n  \"gap_histogram\": {";
+        bool first = true;
+        for (int i = 0; i < 64; i++) {
+            if (l.gap_histogram[i] == 0) continue;
+            os << (first ? "" : ", ") << "\"" << (uint64_t(1) << i) << "\": " << l.gap_histogram[i];
+            first = false;
+        }
+        os << "},\n  \"page_size\": " << l.page_size << ", \"pages\": " << l.pages
+            << ", \"page_bytes\": " << l.page_bytes << ", \"sparse_pages\": " << l.sparse_pages
+            << ",\n  \"fill_histogram\": [";
+        for (int i = 0; i < 10; i++) {
+            os << (i > 0 ? ", " : "") << l.fill_histogram[i];
+        }
+        os << "],\n  \"kinds\": [";
+        first = true;
+        for (size_t i = 0; i < l.kinds.size(); i++) {
+            const auto &k = l.kinds[i];
+            if (k.count == 0) continue;
+            os << (first ? "\n" : ",\n") << "    {\"kind\": \"" << slot_name(i) << "\", \"count\": " << k.count
+                << ", \"bytes\": " << k.bytes << ", \"pages\": " << k.pages << ", \"runs\": " << k.runs
+                << ", \"mean_stride\": " << (k.count > 1 ? k.stride / (k.count - 1) : 0) << "}";
+            first = false;
+        }
+        os << "\n  ]\n}\n";
+    }
+
+    bool write_heatmap(const Layout &l, const std::string &path)
+    {
+        if (l.page_fill.empty()) return false;
+        const uint64_t width = 512;
+        uint64_t first = l.page_fill.front().first;
+        uint64_t count = l.page_fill.back().first - first + 1;
+        uint64_t per_pixel = (count + width * width - 1) / (width * width);
+        uint64_t pixels = (count + per_pixel - 1) / per_pixel;
+        uint64_t height = (pixels + width - 1) / width;
+
+        std::vector<double> fill(width * height, -1);
+        for (const auto &p : l.page_fill) {
+            auto &f = fill[(p.first - first) / per_pixel];
+            f = std::max(f, 0.0) + static_cast<double>(p.second) / (per_pixel * l.page_size);
+        }
+        std::ofstream fo(path, std::ofstream::binary | std::ofstream::trunc);
+        fo << "P6\n" << width << " " << height << "\n255\n";
+        for (auto f : fill) {
+            unsigned char rgb[3] = { 0, 0, 0 };
+            if (f >= 0) {
+                /* blue when nearly empty, through green, to red when full */
+                double x = std::min(f, 1.0);
+                rgb[0] = static_cast<unsigned char>(255 * std::max(0.0, 2 * x - 1));
+                rgb[1] = static_cast<unsigned char>(255 * (1 - std::fabs(2 * x - 1)));
+                rgb[2] = static_cast<unsigned char>(255 * std::max(0.0, 1 - 2 * x));
+                if (rgb[0] + rgb[1] + rgb[2] == 0) rgb[2] = 64;
+            }
+            fo.write(reinterpret_cast<const char*>(rgb), sizeof(rgb));
+        }
+        if (!fo.good()) {
+            std::cout << "Failed to write the heatmap to " << path << std::endl;
+            return false;
+        }
+        std::cout << "Heatmap of " << count << " pages, " << per_pixel << " a pixel, written to " << path << std::endl;
+        return true;
+    }
+}
+
+void LayoutReport::radix_sort(std::vector<Object> &objects)
+{
+    std::vector<Object> tmp(objects.size());
+    std::vector<size_t> counts(1 << 16);
+    for (int shift = 0; shift < 64; shift += 16) {
+        std::fill(counts.begin(), counts.end(), 0);
+        for (const auto &o : objects) {
+            ++counts[(o.address >> shift) & 0xFFFF];
+        }
+        if (!objects.empty() && counts[(objects.front().address >> shift) & 0xFFFF] == objects.size()) {
+            continue; /* every key has the same digit */
+        }
+        size_t sum = 0;
+        for (auto &c : counts) {
+            auto n = c;
+            c = sum;
+            sum += n;
+        }
+        for (const auto &o : objects) {
+            tmp[counts[(o.address >> shift) & 0xFFFF]++] = o;
+        }
+        objects.swap(tmp);
+    }
+}
+
+bool LayoutReport::write(MemoryDump &dump, const cmd_opt &opt)
+{
+    std::vector<Object> objects;
+    objects.reserve(dump.nodes.size());
+    for (const auto &pair : dump.nodes) {
+        const auto &node = pair.second;
+        if (node.label == 0) continue; /* NIL */
+        Object o = { node.label, node.size, node.node_type };
+        objects.push_back(o);
+    }
+    auto start = std::chrono::steady_clock::now();
+    radix_sort(objects);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << objects.size() << " addresses sorted in " << elapsed.count() << " seconds" << std::endl;
+
+    Layout layout;
+    analyze(objects, opt.page_size, !opt.heatmap_file.empty(), layout);
+    if (!opt.heatmap_file.empty()) write_heatmap(layout, opt.heatmap_file);
+    if (opt.layout_report.empty()) return true;
+
+    const auto &path = opt.layout_report;
+    if (path == "-") {
+        write_text(layout, std::cout);
+        return true;
+    }
+    bool json = path.size() > 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    std::ofstream fo(path, std::ofstream::trunc);
+    if (json) {
+        write_json(layout, fo);
+    }
+    else {
+        write_text(layout, fo);
+    }
+    if (!fo.good()) {
+        std::cout << "Failed to write the layout report to " << path << std::endl;
+        return false;
+    }
+    std::cout << "Layout report written to " << path << std::endl;
+    return true;
+}
@@ -0,0 +1,47 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_LAYOUT_H
+#define D2D_LAYOUT_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class MemoryDump;
+class cmd_opt;
+
+/* --layout: where the objects are. Labels are the interpreter's addresses
+ * and sizes its object sizes, so once the labels are sorted (LSD radix,
+ * 16 bits a pass, passes all keys agree on are skipped) we get the span,
+ * the gaps and overlaps between neighbours, how full every --page sized
+ * page or arena is, and how clustered each kind is. As text, or as JSON when
+ * the file name ends in .json. --heatmap FILE draws the page occupancy as a
+ * PPM image, one pixel per page or run of pages, black where nothing is */
+class LayoutReport {
+public:
+    struct Object {
+        uint64_t address;
+        uint32_t size;
+        int32_t kind;
+    };
+
+    static void radix_sort(std::vector<Object> &objects);
+    static bool write(MemoryDump &dump, const cmd_opt &opt);
+};
+
+#endif //D2D_LAYOUT_H
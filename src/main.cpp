@@ -15,8 +15,79 @@
 */
 
 #include <iostream>
+#include <fstream>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <csignal>
 #include "cmd_parse.h"
 #include "dump.h"
+#include "external.h"
+#include "index.h"
+#include "sample.h"
+#include "binary.h"
+#include "filter.h"
+#include "group.h"
+#include "layout.h"
+#include "report.h"
+#include "batch.h"
+#include "shard.h"
+#include "reader.h"
+#include "writer.h"
+#include "multi.h"
+
+static volatile std::sig_atomic_t export_requested = 0;
+
+#ifdef SIGUSR1
+static void request_export(int)
+{
+    export_requested = 1;
+}
+#endif
+
+static void follow(MemoryDump &dump, const cmd_opt &opt)
+{
+#ifdef SIGUSR1
+    std::signal(SIGUSR1, request_export);
+#endif
+    std::cout << "Following '" << opt.ifile << "' every " << opt.follow_interval << " seconds" << std::endl;
+    const auto step = std::chrono::milliseconds(100);
+    const auto interval = std::chrono::duration<double>(opt.follow_interval);
+    bool pending = false;
+    while (true) {
+        auto deadline = std::chrono::steady_clock::now() + interval;
+        while (!export_requested && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(step);
+        }
+        if (dump.follow() > 0) {
+            pending = true;
+        }
+        if (pending || export_requested) {
+            export_requested = 0;
+            pending = false;
+            dump.write_output(opt);
+            std::cout << "exported to '" << opt.ofile << "'" << std::endl;
+        }
+    }
+}
+
+static void write_profile(const MemoryDump &dump, const Profile *profile, const std::string &path)
+{
+    if (profile == nullptr) return;
+    dump.report_profile();
+    if (path == "-") {
+        /* std::cout groups the digits by the user's locale, JSON does not */
+        auto locale = std::cout.imbue(std::locale::classic());
+        profile->write_json(std::cout);
+        std::cout.imbue(locale);
+        return;
+    }
+    std::ofstream fo(path, std::ofstream::trunc);
+    profile->write_json(fo);
+    if (!fo.good()) {
+        std::cout << "Failed to write the profile to " << path << std::endl;
+    }
+}
 
 int main(int argc, char **argv)
 {
@@ -45,13 +116,126 @@ int main(int argc, char **argv)
 
     std::cout.imbue(std::locale(""));
 
+    EdgePolicy policy;
+    std::string policy_error;
+    if (!policy.parse(opt.edge_policy, policy_error)) {
+        std::cout << "Invalid edge policy: " << policy_error << std::endl;
+        return EXIT_FAILURE;
+    }
+    BlockReader::Codec codec;
+    int level;
+    if (!AsyncWriter::parse_codec(opt.compress, opt.ofile, codec, level)) {
+        std::cout << "Invalid output compression: " << opt.compress << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<cmd_opt> batch;
+    if (!opt.batch_file.empty() && !BatchRunner::read_spec(opt.batch_file, opt, batch)) {
+        return EXIT_FAILURE;
+    }
+    if (opt.columns_conflict()) {
+        std::cout << "-e COLUMNS cannot be combined with --top, --why or --group-by" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!opt.group_by.empty()) {
+        GroupBy groups;
+        if (!groups.parse(opt.group_by)) {
+            std::cout << "Invalid group-by keys: " << groups.parse_error() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (!opt.filter.empty()) {
+        NodeFilter filter;
+        if (!filter.parse(opt.filter)) {
+            std::cout << "Invalid filter: " << filter.parse_error() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<std::string> inputs;
+    if (!MultiImport::expand(opt.ifiles, inputs)) {
+        return EXIT_FAILURE;
+    }
+    if (!inputs.empty()) opt.ifile = inputs.front();
+    if (inputs.size() > 1
+        && (!opt.convert_file.empty() || opt.sample > 0 || opt.use_index || opt.memory_budget > 0 || opt.follow_interval > 0)) {
+        std::cout << "Several inputs can be imported but not converted, sampled, indexed, spilled or followed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (BlockReader::is_stream(opt.ifile)
+        && (!opt.convert_file.empty() || opt.sample > 0 || opt.use_index || opt.memory_budget > 0 || opt.follow_interval > 0)) {
+        std::cout << "'" << opt.ifile << "' can only be read once, it can be imported but not converted, sampled, indexed, spilled or followed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
     try {
+        if (!opt.convert_file.empty()) {
+            return BinaryDump::convert(opt.ifile, opt.convert_file) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        if (opt.sample > 0) {
+            DumpSampler sampler(opt.sample);
+            if (!sampler.sample(opt.ifile)) {
+                return EXIT_FAILURE;
+            }
+            sampler.report(std::cout);
+            return EXIT_SUCCESS;
+        }
+
         MemoryDump dump;
-        if (!dump.import(opt.ifile)) {
+        std::unique_ptr<Profile> profile;
+        if (!opt.profile_file.empty()) {
+            profile.reset(new Profile());
+            dump.set_profile(profile.get());
+        }
+        dump.set_kind_breakdown(opt.kind_breakdown);
+        bool dedup = opt.dedup;
+        for (const auto &b : batch) dedup = dedup || b.dedup;
+        dump.set_hash_consing(dedup);
+        dump.set_edge_policy(policy);
+        dump.set_following(opt.follow_interval > 0);
+        if (opt.use_index && !(opt.nodes.empty() && opt.labels.empty())) {
+            DumpIndex index;
+            if (!index.open(opt.ifile, opt.memory_budget)) {
+                std::cout << "Failed to index the input" << std::endl;
+                return EXIT_FAILURE;
+            }
+            cmd_opt query = opt;
+            query.nodes.clear();
+            query.labels = index.query(dump, opt);
+            dump.write_output(query);
+            write_profile(dump, profile.get(), opt.profile_file);
+            return EXIT_SUCCESS;
+        }
+        if (opt.memory_budget > 0) {
+            ExternalDump external(opt.memory_budget, opt.tmp_dir);
+            if (!external.import(opt.ifile) || !external.load(dump, opt.threshold, opt.labels)) {
+                std::cout << "Failed to parse the input" << std::endl;
+                return EXIT_FAILURE;
+            }
+            dump.write_output(opt);
+            write_profile(dump, profile.get(), opt.profile_file);
+            return EXIT_SUCCESS;
+        }
+        if (inputs.size() > 1 ? !MultiImport::import(dump, inputs, opt.jobs) : !dump.import(opt.ifile)) {
             std::cout << "Failed to parse the input" << std::endl;
         }
         dump.update_subtree_size();
+        if (!opt.batch_file.empty() || !opt.shard_dir.empty()) {
+            dump.build_levels();
+            bool ok = opt.batch_file.empty() ? ShardExport::run(dump, opt) : BatchRunner::run(dump, batch, opt.jobs);
+            write_profile(dump, profile.get(), opt.profile_file);
+            return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
         dump.write_output(opt);
+        if (!opt.kind_report.empty()) {
+            KindReport::write(dump, opt);
+        }
+        if (!opt.layout_report.empty() || !opt.heatmap_file.empty()) {
+            LayoutReport::write(dump, opt);
+        }
+        write_profile(dump, profile.get(), opt.profile_file);
+        if (opt.follow_interval > 0) {
+            follow(dump, opt);
+        }
     }
     catch (...) {
         std::cout << "Unexpected error hanppend" << std::endl;
@@ -0,0 +1,256 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <glob.h>
+#endif
+
+#include "dump.h"
+#include "binary.h"
+#include "reader.h"
+#include "multi.h"
+
+namespace {
+    const size_t CHUNK_RECORDS = 1 << 14;
+    const size_t QUEUED_CHUNKS = 8;
+    const size_t REPORTED_FAILURES = 10;
+}
+
+/* one input: the parsing worker fills `chunks', the merging thread drains them */
+struct MultiImport::Source {
+    std::string path;
+    bool binary;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<std::vector<DumpRecord>> chunks;
+    bool done;
+    std::string error;
+    std::vector<std::string> failures; /* the first few lines that did not parse */
+    uint64_t lines;
+    uint64_t parse_failures;
+    uint64_t bytes;
+    double seconds;
+
+    Source(const std::string &path_)
+        : path(path_), binary(false), done(false),
+        lines(0), parse_failures(0), bytes(0), seconds(0)
+    {}
+};
+
+void MultiImport::parse(Source &src)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<DumpRecord> chunk;
+    chunk.reserve(CHUNK_RECORDS);
+    auto push = [&]() {
+        std::unique_lock<std::mutex> guard(src.lock);
+        src.changed.wait(guard, [&src]() {
+            return src.chunks.size() < QUEUED_CHUNKS;
+        });
+        src.chunks.push_back(std::move(chunk));
+        chunk.clear();
+        chunk.reserve(CHUNK_RECORDS);
+        src.changed.notify_all();
+    };
+
+    bool stream = BlockReader::is_stream(src.path);
+    BlockReader reader(stream ? 4 << 20 : 1 << 20, stream ? 2 : 4);
+    if (reader.open(src.path)) {
+        DumpRecord rec;
+        while (auto line = reader.next_line()) {
+            ++src.lines;
+            Parse_Result result;
+            try {
+                result = parse_record(line, rec);
+            }
+            catch (...) {
+                result = PARSE_FAIL;
+            }
+            if (result == PARSE_FAIL) {
+                if (src.failures.size() < REPORTED_FAILURES) {
+                    src.failures.push_back("line " + std::to_string(src.lines) + ": " + line);
+                }
+                ++src.parse_failures;
+                continue;
+            }
+            else if (result == PARSE_COMMENT) {
+                continue;
+            }
+            chunk.push_back(rec);
+            if (chunk.size() == CHUNK_RECORDS) push();
+        }
+    }
+    if (!chunk.empty()) push();
+
+    std::lock_guard<std::mutex> guard(src.lock);
+    src.error = reader.error();
+    src.bytes = reader.compressed_bytes();
+    src.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    src.done = true;
+    src.changed.notify_all();
+}
+
+MultiImport::FileStats MultiImport::merge(MemoryDump &dump, Source &src)
+{
+    FileStats fs = { dump.stats.records, dump.stats.duplicates, dump.nodes.size() };
+    if (src.binary) {
+        /* load() only counts the records of its own file */
+        auto records = dump.stats.records;
+        auto start = std::chrono::steady_clock::now();
+        std::ifstream fb(src.path, std::ifstream::binary | std::ifstream::ate);
+        src.bytes = fb.good() ? static_cast<uint64_t>(fb.tellg()) : 0;
+        fb.seekg(0);
+        if (!BinaryDump::load(fb, dump)) {
+            src.error = "not a valid binary dump";
+        }
+        dump.stats.records += records;
+        src.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    for (;;) {
+        std::vector<DumpRecord> chunk;
+        {
+            std::unique_lock<std::mutex> guard(src.lock);
+            src.changed.wait(guard, [&src]() {
+                return src.done || !src.chunks.empty();
+            });
+            if (src.chunks.empty()) break;
+            chunk = std::move(src.chunks.front());
+            src.chunks.pop_front();
+            src.changed.notify_all();
+        }
+        for (const auto &rec : chunk) {
+            Node node;
+            dump.make_node(rec, node);
+            ++dump.stats.records;
+            bool changed;
+            dump.merge_node(node, changed);
+        }
+    }
+    for (const auto &f : src.failures) {
+        std::cout << "Failed to parse " << src.path << " " << f << std::endl;
+    }
+    if (!src.error.empty()) {
+        std::cout << "Failed to read '" << src.path << "': " << src.error << std::endl;
+    }
+    dump.stats.lines += src.lines;
+    dump.stats.parse_failures += src.parse_failures;
+    fs.records = dump.stats.records - fs.records;
+    fs.duplicates = dump.stats.duplicates - fs.duplicates;
+    fs.nodes = dump.nodes.size() - fs.nodes;
+    return fs;
+}
+
+bool MultiImport::expand(const std::vector<std::string> &patterns, std::vector<std::string> &files)
+{
+    files.clear();
+    for (const auto &p : patterns) {
+#ifndef _WIN32
+        if (p.find_first_of("*?[") != std::string::npos) {
+            glob_t g;
+            int ret = glob(p.c_str(), 0, nullptr, &g);
+            if (ret != 0) {
+                std::cout << "No file matches '" << p << "'" << std::endl;
+                if (ret == GLOB_NOMATCH) globfree(&g);
+                return false;
+            }
+            for (size_t i = 0; i < g.gl_pathc; i++) {
+                files.push_back(g.gl_pathv[i]);
+            }
+            globfree(&g);
+            continue;
+        }
+#endif
+        files.push_back(p);
+    }
+    return true;
+}
+
+bool MultiImport::import(MemoryDump &dump, const std::vector<std::string> &files, int jobs)
+{
+    auto start = std::chrono::steady_clock::now();
+    dump.reset();
+    Node nil(0, "NIL");
+    dump.nodes[nil.label] = nil;
+
+    std::vector<std::unique_ptr<Source>> sources;
+    for (const auto &f : files) {
+        sources.push_back(std::unique_ptr<Source>(new Source(f)));
+        auto &src = *sources.back();
+        if (!BlockReader::is_stream(f)) {
+            std::ifstream fb(f, std::ifstream::binary);
+            src.binary = BinaryDump::is_binary(fb);
+        }
+        if (src.binary) src.done = true;
+    }
+
+    /* files are taken in order, so the one being merged always has a worker */
+    if (jobs <= 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < jobs && i < static_cast<int>(files.size()); i++) {
+        workers.push_back(std::thread([&]() {
+            for (;;) {
+                size_t n = next++;
+                if (n >= sources.size()) break;
+                if (!sources[n]->binary) parse(*sources[n]);
+            }
+        }));
+    }
+
+    std::vector<FileStats> per_file;
+    bool ok = true;
+    {
+        Profile::Scope scope(dump.profile, "parse");
+        for (auto &s : sources) {
+            per_file.push_back(merge(dump, *s));
+            ok = ok && s->error.empty();
+        }
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+    if (!ok) return false;
+
+    std::cout << std::left << std::setw(32) << "file" << std::right << std::setw(12) << "records"
+        << std::setw(12) << "new nodes" << std::setw(12) << "duplicates" << std::setw(10) << "failed"
+        << std::setw(14) << "bytes" << std::setw(10) << "seconds" << std::endl;
+    for (size_t i = 0; i < sources.size(); i++) {
+        const auto &src = *sources[i];
+        std::cout << std::left << std::setw(32) << src.path << std::right
+            << std::setw(12) << per_file[i].records << std::setw(12) << per_file[i].nodes
+            << std::setw(12) << per_file[i].duplicates << std::setw(10) << src.parse_failures
+            << std::setw(14) << src.bytes << std::setw(10) << std::setprecision(3) << src.seconds
+            << std::setprecision(6) << std::endl;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << dump.stats.records << " records from " << files.size() << " files imported in "
+        << elapsed.count() << " seconds by " << workers.size() << " workers" << std::endl;
+
+    dump.link_nodes();
+    return true;
+}
@@ -0,0 +1,51 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_MULTI_H
+#define D2D_MULTI_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class MemoryDump;
+
+/* Several dumps, e.g. one per heap of the interpreter, imported into one
+ * graph. Up to `jobs' files are read and parsed at once, each by a worker
+ * thread handing batches of records through a bounded queue, while the
+ * records are merged into the dump file by file, in command line order:
+ * the result is the same as importing the concatenation of the files, so
+ * duplicate labels across files merge like they do within one, and
+ * references between heaps resolve. Binary dumps are loaded when their
+ * turn comes. Statistics are printed per file */
+class MultiImport {
+private:
+    struct Source;
+    struct FileStats {
+        uint64_t records;
+        uint64_t duplicates;
+        uint64_t nodes;
+    };
+
+    static void parse(Source &src);
+    static FileStats merge(MemoryDump &dump, Source &src);
+public:
+    /* expands the patterns with *, ? or [ in them (not on Windows), sorted */
+    static bool expand(const std::vector<std::string> &patterns, std::vector<std::string> &files);
+    static bool import(MemoryDump &dump, const std::vector<std::string> &files, int jobs);
+};
+
+#endif //D2D_MULTI_H
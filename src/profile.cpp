@@ -0,0 +1,166 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#include <cstring>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "profile.h"
+
+namespace {
+    const char *hw_names[] = { "cycles", "instructions", "cache_misses", "branch_misses" };
+}
+
+Profile::Profile()
+    : hw_enabled(false)
+{
+    for (auto &fd : hw_fd) fd = -1;
+#ifdef __linux__
+    const uint64_t configs[HW_MAX] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for (int i = 0; i < HW_MAX; i++) {
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        hw_fd[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        if (hw_fd[i] < 0) break;
+        hw_enabled = true;
+    }
+    for (auto fd : hw_fd) {
+        if (fd < 0) hw_enabled = false;
+    }
+#endif
+}
+
+Profile::~Profile()
+{
+#ifdef __linux__
+    for (auto fd : hw_fd) {
+        if (fd >= 0) close(fd);
+    }
+#endif
+}
+
+void Profile::sample(Sample &s, bool wall_only) const
+{
+    s.wall = std::chrono::steady_clock::now();
+    s.cpu = wall_only ? 0 : std::clock();
+    for (int i = 0; i < HW_MAX; i++) {
+        s.hw[i] = 0;
+#ifdef __linux__
+        if (hw_enabled && !wall_only && read(hw_fd[i], &s.hw[i], sizeof(s.hw[i])) != sizeof(s.hw[i])) {
+            s.hw[i] = 0;
+        }
+#endif
+    }
+}
+
+void Profile::add(const char *name, const Sample &start, const Sample &end, bool wall_only)
+{
+    Phase *phase = nullptr;
+    for (auto &p : phases) {
+        if (p.name == name) {
+            phase = &p;
+            break;
+        }
+    }
+    if (phase == nullptr) {
+        phases.push_back(Phase());
+        phase = &phases.back();
+        phase->name = name;
+        phase->wall = phase->cpu = 0;
+        phase->calls = 0;
+        phase->wall_only = wall_only;
+        for (auto &h : phase->hw) h = 0;
+    }
+    phase->wall += std::chrono::duration<double>(end.wall - start.wall).count();
+    phase->cpu += static_cast<double>(end.cpu - start.cpu) / CLOCKS_PER_SEC;
+    phase->calls++;
+    for (int i = 0; i < HW_MAX; i++) {
+        phase->hw[i] += end.hw[i] - start.hw[i];
+    }
+}
+
+void Profile::add(std::vector<std::pair<std::string, uint64_t>> &v, const char *name, uint64_t n, bool sum)
+{
+    for (auto &c : v) {
+        if (c.first == name) {
+            c.second = sum ? c.second + n : n;
+            return;
+        }
+    }
+    v.push_back(std::make_pair(std::string(name), n));
+}
+
+Profile::Scope::Scope(Profile *profile_, const char *name_, bool wall_only_)
+    : profile(profile_),
+    name(name_),
+    wall_only(wall_only_)
+{
+    if (profile != nullptr) profile->sample(start, wall_only);
+}
+
+Profile::Scope::~Scope()
+{
+    if (profile == nullptr) return;
+    Sample end;
+    profile->sample(end, wall_only);
+    profile->add(name, start, end, wall_only);
+}
+
+void Profile::write_json(std::ostream &os) const
+{
+    auto write_pairs = [&os](const std::vector<std::pair<std::string, uint64_t>> &v) {
+        os << "{";
+        for (size_t i = 0; i < v.size(); i++) {
+            os << (i > 0 ? ", " : "") << "\"" << v[i].first << "\": " << v[i].second;
+        }
+        os << "}";
+    };
+
+    os << "{\n  \"phases\": [\n";
+    for (size_t i = 0; i < phases.size(); i++) {
+        const auto &p = phases[i];
+        os << "    {\"phase\": \"" << p.name << "\", \"wall_seconds\": " << p.wall;
+        if (!p.wall_only) {
+            os << ", \"cpu_seconds\": " << p.cpu;
+        }
+        os << ", \"calls\": " << p.calls;
+        if (hw_enabled && !p.wall_only) {
+            for (int h = 0; h < HW_MAX; h++) {
+                os << ", \"" << hw_names[h] << "\": " << p.hw[h];
+            }
+        }
+        os << "}" << (i + 1 < phases.size() ? "," : "") << "\n";
+    }
+    os << "  ],\n  \"counts\": ";
+    write_pairs(counts);
+    os << ",\n  \"memory_bytes\": ";
+    write_pairs(memory);
+    os << ",\n  \"hardware_counters\": " << (hw_enabled ? "true" : "false") << "\n}\n";
+}
@@ -0,0 +1,95 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_PROFILE_H
+#define D2D_PROFILE_H
+
+#include <cstdint>
+#include <chrono>
+#include <ctime>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/* Per-phase wall/CPU time, counters and memory figures of a run (--profile).
+ * On Linux, hardware counters are read through perf_event when the kernel
+ * lets us open them */
+class Profile {
+public:
+    enum {
+        HW_CYCLES,
+        HW_INSTRUCTIONS,
+        HW_CACHE_MISSES,
+        HW_BRANCH_MISSES,
+        HW_MAX
+    };
+
+    struct Sample {
+        std::chrono::steady_clock::time_point wall;
+        std::clock_t cpu;
+        uint64_t hw[HW_MAX];
+    };
+
+    /* times what happens between its construction and destruction,
+     * adding to the phase if it was already measured. A null profile makes
+     * it a no-op. Scopes entered per node should be `wall_only', reading
+     * the CPU time and hardware counters costs system calls */
+    class Scope {
+    private:
+        Profile *profile;
+        const char *name;
+        bool wall_only;
+        Sample start;
+    public:
+        Scope(Profile *profile_, const char *name_, bool wall_only_ = false);
+        ~Scope();
+    };
+
+private:
+    struct Phase {
+        std::string name;
+        double wall;
+        double cpu;
+        uint64_t calls;
+        bool wall_only;
+        uint64_t hw[HW_MAX];
+    };
+
+    std::vector<Phase> phases;
+    std::vector<std::pair<std::string, uint64_t>> counts;
+    std::vector<std::pair<std::string, uint64_t>> memory;
+    int hw_fd[HW_MAX];
+    bool hw_enabled;
+
+    void sample(Sample &s, bool wall_only) const;
+    void add(const char *name, const Sample &start, const Sample &end, bool wall_only);
+    static void add(std::vector<std::pair<std::string, uint64_t>> &v, const char *name, uint64_t n, bool sum);
+public:
+    Profile();
+    ~Profile();
+
+    void count(const char *name, uint64_t n = 1)
+    {
+        add(counts, name, n, true);
+    }
+    void set_memory(const char *name, uint64_t bytes)
+    {
+        add(memory, name, bytes, false);
+    }
+    void write_json(std::ostream &os) const;
+};
+
+#endif //D2D_PROFILE_H
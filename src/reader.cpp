@@ -0,0 +1,355 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#ifdef D2D_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef D2D_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "reader.h"
+
+namespace {
+    const unsigned char GZIP_MAGIC[] = { 0x1f, 0x8b };
+    const unsigned char ZSTD_MAGIC[] = { 0x28, 0xb5, 0x2f, 0xfd };
+    const size_t INPUT_SIZE = 1 << 18;
+}
+
+struct BlockReader::Decoder {
+#ifdef D2D_HAVE_ZLIB
+    z_stream z;
+    bool z_init;
+#endif
+#ifdef D2D_HAVE_ZSTD
+    ZSTD_DStream *zstd;
+#endif
+    bool ended; /* at the end of a gzip member or zstd frame */
+    Decoder()
+        : ended(true)
+    {
+#ifdef D2D_HAVE_ZLIB
+        z_init = false;
+#endif
+#ifdef D2D_HAVE_ZSTD
+        zstd = nullptr;
+#endif
+    }
+    ~Decoder()
+    {
+#ifdef D2D_HAVE_ZLIB
+        if (z_init) inflateEnd(&z);
+#endif
+#ifdef D2D_HAVE_ZSTD
+        if (zstd != nullptr) ZSTD_freeDStream(zstd);
+#endif
+    }
+};
+
+BlockReader::BlockReader(size_t block_size, size_t blocks)
+    : file(nullptr),
+    owned(true),
+    codec_(CODEC_PLAIN),
+    in(INPUT_SIZE),
+    in_pos(0),
+    in_size(0),
+    in_eof(false),
+    read_bytes(0),
+    decoded_bytes(0),
+    ring(blocks < 2 ? 2 : blocks),
+    head(0),
+    tail(0),
+    done(false),
+    stopping(false),
+    current(nullptr),
+    pos(0)
+{
+    for (auto &b : ring) {
+        b.data.resize(block_size);
+        b.size = 0;
+    }
+}
+
+BlockReader::~BlockReader()
+{
+    close();
+}
+
+void BlockReader::close()
+{
+    if (thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        drained.notify_all();
+        thread.join();
+    }
+    if (file != nullptr && owned) std::fclose(file);
+    file = nullptr;
+}
+
+BlockReader::Codec BlockReader::detect(const unsigned char *magic, size_t n)
+{
+    if (n >= sizeof(GZIP_MAGIC) && !std::memcmp(magic, GZIP_MAGIC, sizeof(GZIP_MAGIC))) {
+        return CODEC_GZIP;
+    }
+    if (n >= sizeof(ZSTD_MAGIC) && !std::memcmp(magic, ZSTD_MAGIC, sizeof(ZSTD_MAGIC))) {
+        return CODEC_ZSTD;
+    }
+    return CODEC_PLAIN;
+}
+
+BlockReader::Codec BlockReader::detect(const std::string &path)
+{
+    std::FILE *f = std::fopen(path.c_str(), "rb");
+    if (f == nullptr) return CODEC_PLAIN;
+    unsigned char magic[sizeof(ZSTD_MAGIC)];
+    size_t n = std::fread(magic, 1, sizeof(magic), f);
+    std::fclose(f);
+    return detect(magic, n);
+}
+
+bool BlockReader::is_stream(const std::string &path)
+{
+    if (path == "-") return true;
+#ifdef _WIN32
+    return false;
+#else
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISFIFO(st.st_mode);
+#endif
+}
+
+const char *BlockReader::codec_name(Codec codec)
+{
+    switch (codec) {
+    case CODEC_GZIP: return "gzip";
+    case CODEC_ZSTD: return "zstd";
+    default: return "plain";
+    }
+}
+
+bool BlockReader::open(const std::string &path)
+{
+    close();
+    owned = path != "-";
+    if (owned) {
+        file = std::fopen(path.c_str(), "rb");
+    }
+    else {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        file = stdin;
+    }
+    if (file == nullptr) {
+        error_ = "failed to open " + path;
+        return false;
+    }
+    /* the first bytes tell the codec, they are decoded like the rest */
+    read_input();
+    codec_ = detect(reinterpret_cast<const unsigned char*>(in.data()), in_size);
+    decoder.reset(new Decoder());
+#ifndef D2D_HAVE_ZLIB
+    if (codec_ == CODEC_GZIP) error_ = "gzip input needs zlib support";
+#endif
+#ifndef D2D_HAVE_ZSTD
+    if (codec_ == CODEC_ZSTD) error_ = "zstd input needs libzstd support";
+#endif
+    if (!error_.empty()) return false;
+
+    head = tail = 0;
+    done = stopping = false;
+    current = nullptr;
+    thread = std::thread(&BlockReader::run, this);
+    return true;
+}
+
+bool BlockReader::read_input()
+{
+    if (in_pos < in_size) return true;
+    if (in_eof) return false;
+    in_pos = 0;
+    in_size = std::fread(in.data(), 1, in.size(), file);
+    read_bytes += in_size;
+    if (in_size < in.size()) in_eof = true;
+    return in_size > 0;
+}
+
+/* fills `out' with up to `capacity' decoded bytes, 0 at the end of the input */
+size_t BlockReader::decode(char *out, size_t capacity)
+{
+    size_t n = 0;
+    switch (codec_) {
+    case CODEC_PLAIN:
+        while (n < capacity && read_input()) {
+            size_t len = std::min(capacity - n, in_size - in_pos);
+            std::memcpy(out + n, in.data() + in_pos, len);
+            in_pos += len;
+            n += len;
+        }
+        break;
+#ifdef D2D_HAVE_ZLIB
+    case CODEC_GZIP: {
+        auto &z = decoder->z;
+        while (n < capacity && read_input()) {
+            if (decoder->ended) {
+                /* concatenated members, as `cat a.gz b.gz' makes, form one stream */
+                if (decoder->z_init) {
+                    inflateReset(&z);
+                }
+                else {
+                    std::memset(&z, 0, sizeof(z));
+                    decoder->z_init = inflateInit2(&z, 15 + 16) == Z_OK;
+                }
+                if (!decoder->z_init) {
+                    error_ = "failed to initialize zlib";
+                    return 0;
+                }
+                decoder->ended = false;
+            }
+            z.next_in = reinterpret_cast<Bytef*>(in.data() + in_pos);
+            z.avail_in = static_cast<uInt>(in_size - in_pos);
+            z.next_out = reinterpret_cast<Bytef*>(out + n);
+            z.avail_out = static_cast<uInt>(capacity - n);
+            int ret = inflate(&z, Z_NO_FLUSH);
+            in_pos = in_size - z.avail_in;
+            n = capacity - z.avail_out;
+            if (ret == Z_STREAM_END) {
+                decoder->ended = true;
+            }
+            else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                error_ = std::string("corrupt gzip input: ") + (z.msg != nullptr ? z.msg : "inflate failed");
+                return 0;
+            }
+        }
+        break;
+    }
+#endif
+#ifdef D2D_HAVE_ZSTD
+    case CODEC_ZSTD: {
+        if (decoder->zstd == nullptr) {
+            decoder->zstd = ZSTD_createDStream();
+            ZSTD_initDStream(decoder->zstd);
+        }
+        while (n < capacity && read_input()) {
+            ZSTD_inBuffer input = { in.data(), in_size, in_pos };
+            ZSTD_outBuffer output = { out, capacity, n };
+            size_t ret = ZSTD_decompressStream(decoder->zstd, &output, &input);
+            if (ZSTD_isError(ret)) {
+                error_ = std::string("corrupt zstd input: ") + ZSTD_getErrorName(ret);
+                return 0;
+            }
+            in_pos = input.pos;
+            n = output.pos;
+            decoder->ended = ret == 0;
+        }
+        break;
+    }
+#endif
+    default:
+        break;
+    }
+    if (n == 0 && codec_ != CODEC_PLAIN && !decoder->ended) {
+        error_ = std::string("truncated ") + codec_name(codec_) + " input";
+    }
+    return n;
+}
+
+void BlockReader::run()
+{
+    for (;;) {
+        Block *block;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            drained.wait(guard, [this]() {
+                return stopping || head - tail < ring.size();
+            });
+            if (stopping) break;
+            block = &ring[head % ring.size()];
+        }
+        /* the parser does not touch a block until it is counted in `head' */
+        block->size = decode(block->data.data(), block->data.size());
+        decoded_bytes += block->size;
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (block->size == 0 || !error_.empty()) {
+            done = true;
+            filled.notify_all();
+            break;
+        }
+        ++head;
+        filled.notify_all();
+    }
+}
+
+bool BlockReader::acquire()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    filled.wait(guard, [this]() {
+        return done || head > tail;
+    });
+    if (head == tail) return false;
+    current = &ring[tail % ring.size()];
+    pos = 0;
+    return true;
+}
+
+void BlockReader::release()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        ++tail;
+        current = nullptr;
+    }
+    drained.notify_all();
+}
+
+const char *BlockReader::next_line()
+{
+    bool carrying = false;
+    carry.clear();
+    for (;;) {
+        if (current == nullptr && !acquire()) {
+            if (!error_.empty()) return nullptr;
+            return carrying ? carry.c_str() : nullptr;
+        }
+        char *start = current->data.data() + pos;
+        char *end = current->data.data() + current->size;
+        auto nl = static_cast<char*>(std::memchr(start, '\n', end - start));
+        if (nl != nullptr) {
+            *nl = '\0';
+            pos = nl + 1 - current->data.data();
+            if (!carrying) return start;
+            carry.append(start, nl);
+            return carry.c_str();
+        }
+        carry.append(start, end);
+        carrying = true;
+        release();
+    }
+}
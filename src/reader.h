@@ -0,0 +1,121 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_READER_H
+#define D2D_READER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Reads a text dump line by line while a reader thread decompresses it.
+ *
+ * The codec is told by the magic bytes at the beginning of the input. The
+ * thread fills a ring of fixed size blocks and waits when all of them are
+ * full, so the parser works on one block while the next ones are being
+ * decompressed, and memory stays bounded however big the dump is. gzip
+ * needs zlib (D2D_HAVE_ZLIB), zstd needs libzstd (D2D_HAVE_ZSTD).
+ *
+ * "-" reads stdin. Nothing is ever sought, so pipes and FIFOs work as well;
+ * two big blocks are enough there, the producer is the bottleneck */
+class BlockReader {
+public:
+    enum Codec {
+        CODEC_PLAIN,
+        CODEC_GZIP,
+        CODEC_ZSTD
+    };
+
+private:
+    struct Block {
+        std::vector<char> data;
+        size_t size;
+    };
+    struct Decoder;
+
+    std::FILE *file;
+    bool owned; /* false for stdin */
+    Codec codec_;
+    std::unique_ptr<Decoder> decoder;
+    std::vector<char> in; /* compressed bytes read, not decoded yet */
+    size_t in_pos;
+    size_t in_size;
+    bool in_eof;
+    uint64_t read_bytes;
+    uint64_t decoded_bytes;
+
+    std::vector<Block> ring;
+    uint64_t head; /* blocks filled by the thread */
+    uint64_t tail; /* blocks released by the parser */
+    bool done;
+    bool stopping;
+    std::string error_;
+    std::mutex lock;
+    std::condition_variable filled;
+    std::condition_variable drained;
+    std::thread thread;
+
+    Block *current;
+    size_t pos;
+    std::string carry; /* a line split across two blocks */
+
+    bool read_input();
+    size_t decode(char *out, size_t capacity);
+    void run();
+    bool acquire();
+    void release();
+    void close();
+public:
+    BlockReader(size_t block_size = 1 << 20, size_t blocks = 4);
+    ~BlockReader();
+
+    static Codec detect(const unsigned char *magic, size_t n);
+    /* the codec of a file, CODEC_PLAIN if it cannot be read */
+    static Codec detect(const std::string &path);
+    static const char *codec_name(Codec codec);
+    /* stdin or a FIFO, which can only be read once */
+    static bool is_stream(const std::string &path);
+
+    /* opens the file and starts the reader thread */
+    bool open(const std::string &path);
+    /* the next line without its '\n', valid until the next call, or
+     * nullptr at the end of the input or on error() */
+    const char *next_line();
+
+    Codec codec() const
+    {
+        return codec_;
+    }
+    const std::string &error() const
+    {
+        return error_;
+    }
+    uint64_t compressed_bytes() const
+    {
+        return read_bytes;
+    }
+    uint64_t bytes() const
+    {
+        return decoded_bytes;
+    }
+};
+
+#endif //D2D_READER_H
@@ -0,0 +1,143 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+
+#include "cmd_parse.h"
+#include "dump.h"
+#include "report.h"
+
+namespace {
+    struct KindTotal {
+        int kind;
+        uint64_t count;
+        double bytes;
+    };
+
+    std::vector<KindTotal> histogram(const std::unordered_map<uintptr_t, Node> &nodes, double &total)
+    {
+        std::vector<KindTotal> slots(KIND_SLOT_COUNT);
+        for (int i = 0; i < KIND_SLOT_COUNT; i++) {
+            slots[i].kind = slot_kind(i);
+            slots[i].count = 0;
+            slots[i].bytes = 0;
+        }
+        total = 0;
+        for (const auto &pair : nodes) {
+            int slot = kind_slot(pair.second.node_type);
+            if (slot < 0 || pair.second.label == 0) continue;
+            slots[slot].count++;
+            slots[slot].bytes += pair.second.size;
+            total += pair.second.size;
+        }
+        slots.erase(std::remove_if(slots.begin(), slots.end(),
+            [](const KindTotal &k) { return k.count == 0; }), slots.end());
+        std::sort(slots.begin(), slots.end(), [](const KindTotal &a, const KindTotal &b) {
+            return a.bytes > b.bytes;
+        });
+        return slots;
+    }
+
+    const char *column_name(int kind)
+    {
+        return kind < 0 ? "OTHER" : kind_name(kind);
+    }
+}
+
+bool KindReport::write(MemoryDump &dump, const cmd_opt &opt)
+{
+    const auto &path = opt.kind_report;
+    bool json = path.size() > 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    if (path == "-") {
+        write_text(dump, opt, std::cout);
+        return true;
+    }
+    std::ofstream fo(path, std::ofstream::trunc);
+    if (json) {
+        write_json(dump, opt, fo);
+    }
+    else {
+        write_text(dump, opt, fo);
+    }
+    if (!fo.good()) {
+        std::cout << "Failed to write the kind report to " << path << std::endl;
+        return false;
+    }
+    std::cout << "Kind report written to " << path << std::endl;
+    return true;
+}
+
+void KindReport::write_text(MemoryDump &dump, const cmd_opt &opt, std::ostream &os)
+{
+    double total;
+    auto kinds = histogram(dump.nodes, total);
+    os << "By kind:" << std::endl;
+    os << std::left << std::setw(16) << "kind" << std::right << std::setw(12) << "count"
+        << std::setw(16) << "bytes" << std::setw(9) << "%" << std::endl;
+    for (const auto &k : kinds) {
+        os << std::left << std::setw(16) << kind_name(k.kind) << std::right
+            << std::setw(12) << k.count
+            << std::setw(16) << static_cast<uint64_t>(k.bytes)
+            << std::setw(8) << std::fixed << std::setprecision(2) << (total > 0 ? 100 * k.bytes / total : 0) << "%"
+            << std::defaultfloat << std::endl;
+    }
+
+    std::vector<std::pair<int, double>> breakdown;
+    for (auto node : dump.select_nodes(opt)) {
+        if (!dump.kind_breakdown(*node, breakdown)) continue;
+        os << std::endl << node->name.str() << " (0x" << std::hex << node->label << std::dec << "), "
+            << static_cast<uint64_t>(node->subtree_size) << " bytes:" << std::endl;
+        for (const auto &k : breakdown) {
+            os << "  " << std::left << std::setw(16) << column_name(k.first) << std::right
+                << std::setw(16) << static_cast<uint64_t>(k.second)
+                << std::setw(8) << std::fixed << std::setprecision(2)
+                << (node->subtree_size > 0 ? 100 * k.second / node->subtree_size : 0) << "%"
+                << std::defaultfloat << std::endl;
+        }
+    }
+}
+
+void KindReport::write_json(MemoryDump &dump, const cmd_opt &opt, std::ostream &os)
+{
+    double total;
+    auto kinds = histogram(dump.nodes, total);
+    os << "{\n  \"total_bytes\": " << static_cast<uint64_t>(total) << ",\n  \"kinds\": [\n";
+    for (size_t i = 0; i < kinds.size(); i++) {
+        os << "    {\"kind\": \"" << kind_name(kinds[i].kind) << "\", \"count\": " << kinds[i].count
+            << ", \"bytes\": " << static_cast<uint64_t>(kinds[i].bytes) << "}"
+            << (i + 1 < kinds.size() ? "," : "") << "\n";
+    }
+    os << "  ],\n  \"subtrees\": [";
+
+    std::vector<std::pair<int, double>> breakdown;
+    bool first = true;
+    for (auto node : dump.select_nodes(opt)) {
+        if (!dump.kind_breakdown(*node, breakdown)) continue;
+        os << (first ? "\n" : ",\n") << "    {\"label\": \"0x" << std::hex << node->label << std::dec
+            << "\", \"bytes\": " << static_cast<uint64_t>(node->subtree_size) << ", \"kinds\": {";
+        for (size_t i = 0; i < breakdown.size(); i++) {
+            os << (i > 0 ? ", " : "") << "\"" << column_name(breakdown[i].first) << "\": "
+                << static_cast<uint64_t>(breakdown[i].second);
+        }
+        os << "}}";
+        first = false;
+    }
+    os << "\n  ]\n}\n";
+}
@@ -0,0 +1,36 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_REPORT_H
+#define D2D_REPORT_H
+
+#include <ostream>
+#include <string>
+
+class MemoryDump;
+class cmd_opt;
+
+/* --kind-report: count and bytes of every kind over the whole dump, then the
+ * kind breakdown of each selected subtree (-n, -l, --filter or the top
+ * nodes). As text, or as JSON when the file name ends in .json */
+class KindReport {
+public:
+    static bool write(MemoryDump &dump, const cmd_opt &opt);
+    static void write_text(MemoryDump &dump, const cmd_opt &opt, std::ostream &os);
+    static void write_json(MemoryDump &dump, const cmd_opt &opt, std::ostream &os);
+};
+
+#endif //D2D_REPORT_H
@@ -0,0 +1,194 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <random>
+#include <algorithm>
+
+#include "dump.h"
+#include "kind.h"
+#include "sample.h"
+
+bool DumpSampler::sample_line(const char *line, Sample &s)
+{
+    DumpRecord rec;
+    try {
+        if (parse_record(line, rec) != PARSE_OK) {
+            ++failed;
+            return false;
+        }
+    }
+    catch (...) {
+        ++failed;
+        return false;
+    }
+    s.kind = rec.kind;
+    s.name = rec.has_name ? StringBin(rec.name).index() : -1;
+    s.size = rec.size;
+    return true;
+}
+
+bool DumpSampler::sample(const std::string &path)
+{
+    std::FILE *fi = std::fopen(path.c_str(), "rb");
+    if (fi == nullptr) {
+        std::cout << "Failed to open " << path << std::endl;
+        return false;
+    }
+
+    size_t stride = rate < 1 ? static_cast<size_t>(std::max(1.0, std::floor(1 / rate + 0.5))) : 0;
+    size_t reservoir = rate >= 1 ? static_cast<size_t>(rate) : 0;
+    std::mt19937_64 rng(0x6432640d);
+
+    /* only the sampled lines are parsed, the rest is just scanned for '\n' */
+    std::vector<char> buf(1 << 20);
+    size_t begin = 0, end = 0;
+    bool eof = false;
+    while (true) {
+        char *nl = static_cast<char*>(std::memchr(buf.data() + begin, '\n', end - begin));
+        if (nl == nullptr) {
+            if (eof) {
+                if (begin == end) break;
+                if (end == buf.size()) buf.push_back('\0');
+                nl = buf.data() + end; /* the last line has no '\n' */
+            }
+            else {
+                std::memmove(buf.data(), buf.data() + begin, end - begin);
+                end -= begin;
+                begin = 0;
+                if (end == buf.size()) buf.resize(buf.size() * 2);
+                auto n = std::fread(buf.data() + end, 1, buf.size() - end, fi);
+                if (n == 0) eof = true;
+                end += n;
+                continue;
+            }
+        }
+        char *line = buf.data() + begin;
+        begin = nl - buf.data() + 1;
+        if (begin > end) begin = end;
+
+        while (*line == ' ' || *line == '\t') line++;
+        if (*line == '#' || line == nl || *line == '\r') continue;
+        *nl = '\0';
+
+        ++lines;
+        Sample s;
+        if (stride > 0) {
+            if ((lines - 1) % stride == 0 && sample_line(line, s)) {
+                samples.push_back(s);
+            }
+        }
+        else if (samples.size() < reservoir) {
+            if (sample_line(line, s)) samples.push_back(s);
+        }
+        else {
+            auto j = std::uniform_int_distribution<size_t>(0, lines - 1)(rng);
+            if (j < reservoir && sample_line(line, s)) {
+                samples[j] = s;
+            }
+        }
+    }
+    std::fclose(fi);
+    std::cout << "Sampled " << samples.size() << " of " << lines << " records";
+    if (failed > 0) std::cout << " (" << failed << " failed to parse)";
+    std::cout << std::endl;
+    return true;
+}
+
+DumpSampler::Estimate DumpSampler::estimate(const Group &g) const
+{
+    Estimate e;
+    double n = static_cast<double>(samples.size());
+    double N = static_cast<double>(lines);
+    double fpc = n < N ? 1 - n / N : 0; /* finite population correction */
+    auto total = [&](double sum, double sum2, double &ci) {
+        double mean = sum / n;
+        double var = n > 1 ? (sum2 - n * mean * mean) / (n - 1) : 0;
+        ci = 1.96 * N * std::sqrt(std::max(var, 0.0) * fpc / n);
+        return N * mean;
+    };
+    e.count = total(g.count, g.count, e.count_ci);
+    e.bytes = total(g.sum, g.sum2, e.bytes_ci);
+    return e;
+}
+
+void DumpSampler::report(std::ostream &os, const char *title, const std::unordered_map<int, Group> &groups,
+    size_t limit, bool by_kind) const
+{
+    std::vector<std::pair<int, Estimate>> ranked;
+    double total = 0;
+    for (const auto & g : groups) {
+        ranked.push_back(std::make_pair(g.first, estimate(g.second)));
+        total += ranked.back().second.bytes;
+    }
+    std::sort(ranked.begin(), ranked.end(),
+        [](const std::pair<int, Estimate> &a, const std::pair<int, Estimate> &b) {
+        return a.second.bytes > b.second.bytes;
+    });
+    if (ranked.size() > limit) ranked.resize(limit);
+
+    os << title << std::endl
+        << std::setw(24) << std::left << "" << std::right
+        << std::setw(14) << "count" << std::setw(12) << "+/-"
+        << std::setw(16) << "bytes" << std::setw(14) << "+/-"
+        << std::setw(8) << "%" << std::endl;
+    os << std::fixed << std::setprecision(0);
+    for (const auto & r : ranked) {
+        std::string name;
+        if (by_kind) {
+            name = kind_slot(r.first) >= 0 ? kind_name(r.first) : std::to_string(r.first);
+        }
+        else {
+            name = r.first < 0 ? "(null)" : StringBin::array[r.first];
+        }
+        if (name.size() > 23) name = name.substr(0, 20) + "...";
+        os << std::setw(24) << std::left << name << std::right
+            << std::setw(14) << r.second.count << std::setw(12) << r.second.count_ci
+            << std::setw(16) << r.second.bytes << std::setw(14) << r.second.bytes_ci
+            << std::setw(7) << std::setprecision(1) << (total > 0 ? 100 * r.second.bytes / total : 0)
+            << "%" << std::setprecision(0) << std::endl;
+    }
+    os.unsetf(std::ios_base::floatfield);
+    os << std::setprecision(6) << std::endl;
+}
+
+void DumpSampler::report(std::ostream &os, size_t limit) const
+{
+    if (samples.empty()) {
+        os << "Nothing sampled" << std::endl;
+        return;
+    }
+    std::unordered_map<int, Group> kinds, names;
+    Group all;
+    for (const auto & s : samples) {
+        for (auto g : { &kinds[s.kind], &names[s.name], &all }) {
+            g->count++;
+            g->sum += s.size;
+            g->sum2 += static_cast<double>(s.size) * s.size;
+        }
+    }
+    auto e = estimate(all);
+    os << std::fixed << std::setprecision(0)
+        << "Estimated total: " << e.bytes << " +/- " << e.bytes_ci << " bytes in "
+        << lines << " records (95% confidence, duplicate records counted each time)" << std::endl << std::endl;
+    os.unsetf(std::ios_base::floatfield);
+    report(os, "By kind:", kinds, limit, true);
+    report(os, "By name:", names, limit, false);
+}
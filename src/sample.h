@@ -0,0 +1,67 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_SAMPLE_H
+#define D2D_SAMPLE_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <unordered_map>
+
+/* Quick triage of a dump from a sample of its records: every k-th record
+ * when `rate' < 1 (k = 1 / rate), or a uniform reservoir of `rate' records
+ * otherwise. Totals per kind and per name are estimated as for a simple
+ * random sample, with 95% confidence intervals */
+class DumpSampler {
+private:
+    struct Sample {
+        int kind;
+        int name; /* StringBin index, -1 for (null) */
+        uint32_t size;
+    };
+
+    struct Estimate {
+        double count, count_ci;
+        double bytes, bytes_ci;
+    };
+
+    struct Group {
+        size_t count;
+        double sum;
+        double sum2;
+        Group() : count(0), sum(0), sum2(0) {}
+    };
+
+    double rate;
+    size_t lines;   /* records seen */
+    size_t failed;
+    std::vector<Sample> samples;
+
+    bool sample_line(const char *line, Sample &s);
+    Estimate estimate(const Group &g) const;
+    void report(std::ostream &os, const char *title, const std::unordered_map<int, Group> &groups,
+        size_t limit, bool by_kind) const;
+public:
+    DumpSampler(double rate_)
+        : rate(rate_), lines(0), failed(0)
+    {}
+
+    bool sample(const std::string &path);
+    void report(std::ostream &os, size_t limit = 20) const;
+};
+
+#endif //D2D_SAMPLE_H
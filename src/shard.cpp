@@ -0,0 +1,145 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "cmd_parse.h"
+#include "dump.h"
+#include "export_tree.h"
+#include "kind.h"
+#include "batch.h"
+#include "shard.h"
+
+namespace {
+    const char *extension(const cmd_opt &opt)
+    {
+        if (opt.columns_export) return "columns.json";
+        switch (opt.tree_export) {
+        case TREE_EXPORT_FOLDED: return "folded";
+        case TREE_EXPORT_JSON: return "json";
+        default: break;
+        }
+        switch (opt.export_type) {
+        case EXPORT_GML: return "gml";
+        case EXPORT_GRAPHML: return "graphml";
+        default: return "dot";
+        }
+    }
+
+    bool make_dir(const std::string &dir)
+    {
+#ifdef _WIN32
+        _mkdir(dir.c_str());
+        struct _stat st;
+        return _stat(dir.c_str(), &st) == 0 && (st.st_mode & _S_IFDIR);
+#else
+        mkdir(dir.c_str(), 0777);
+        struct stat st;
+        return stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+    }
+}
+
+bool ShardExport::run(MemoryDump &dump, const cmd_opt &opt)
+{
+    if (!make_dir(opt.shard_dir)) {
+        std::cout << "Failed to create the shard directory '" << opt.shard_dir << "'" << std::endl;
+        return false;
+    }
+
+    /* one shard per top node, NIL (label 0) by its children, or per child
+     * of the nodes given with -n, -l or --filter */
+    std::vector<Node*> candidates;
+    if (opt.nodes.empty() && opt.labels.empty() && opt.filter.empty()) {
+        for (const auto &c : dump.top_level()) {
+            if (c.node->label != 0) {
+                candidates.push_back(c.node);
+                continue;
+            }
+            for (auto &n : c.node->children) {
+                candidates.push_back(n.node);
+            }
+        }
+    }
+    else {
+        for (auto node : dump.select_nodes(opt)) {
+            for (auto &c : node->children) {
+                candidates.push_back(c.node);
+            }
+        }
+    }
+    double min_size = dump.total_size * opt.threshold;
+    std::vector<Node*> roots;
+    std::set<uintptr_t> seen;
+    for (auto node : candidates) {
+        if (node->subtree_size < min_size || !seen.insert(node->label).second) continue;
+        roots.push_back(node);
+    }
+    std::stable_sort(roots.begin(), roots.end(), [](const Node *a, const Node *b) {
+        return a->subtree_size > b->subtree_size;
+    });
+
+    cmd_opt base = opt;
+    base.shard_dir.clear();
+    base.nodes.clear();
+    base.filter.clear();
+    std::vector<cmd_opt> exports;
+    std::vector<std::string> files;
+    for (size_t i = 0; i < roots.size(); i++) {
+        char file[64];
+        std::snprintf(file, sizeof(file), "%04zu-%llx.%s", i,
+            static_cast<unsigned long long>(roots[i]->label), extension(opt));
+        files.push_back(file);
+        cmd_opt shard = base;
+        shard.labels.assign(1, roots[i]->label);
+        shard.ofile = opt.shard_dir + "/" + file;
+        exports.push_back(shard);
+    }
+
+    std::string index_path = opt.shard_dir + "/index.json";
+    std::ofstream index(index_path, std::ofstream::trunc);
+    index << "{\n  \"total_size\": " << static_cast<uint64_t>(dump.total_size)
+        << ",\n  \"threshold\": " << opt.threshold << ",\n  \"shards\": [";
+    for (size_t i = 0; i < roots.size(); i++) {
+        const auto &node = *roots[i];
+        index << (i > 0 ? ",\n" : "\n") << "    {\"file\": ";
+        write_json_string(files[i], index);
+        index << ", \"label\": \"0x" << std::hex << node.label << std::dec << "\", \"name\": ";
+        write_json_string(node.name.str(), index);
+        index << ", \"kind\": \"" << kind_name(node.node_type) << "\""
+            << ", \"size\": " << node.size
+            << ", \"subtree_size\": " << static_cast<uint64_t>(node.subtree_size) << "}";
+    }
+    index << "\n  ]\n}\n";
+    if (!index.good()) {
+        std::cout << "Failed to write " << index_path << std::endl;
+        return false;
+    }
+    std::cout << roots.size() << " shards listed in " << index_path << std::endl;
+
+    return BatchRunner::run(dump, exports, opt.jobs);
+}
@@ -0,0 +1,37 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_SHARD_H
+#define D2D_SHARD_H
+
+#include <string>
+
+class MemoryDump;
+class cmd_opt;
+
+/* --shard DIR: one output file per root instead of one for the whole dump.
+ * The roots are the top nodes, with the children of NIL in its place, or
+ * the children of the nodes selected with -n, -l or --filter; those above
+ * the -t threshold, numbered biggest first. They are written in
+ * parallel like a --batch, each as a -l export, and DIR/index.json lists
+ * every shard's file, root label, name, kind and sizes, so that shards can
+ * be rendered, inspected and regenerated one by one */
+class ShardExport {
+public:
+    static bool run(MemoryDump &dump, const cmd_opt &opt);
+};
+
+#endif //D2D_SHARD_H
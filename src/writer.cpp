@@ -0,0 +1,291 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef D2D_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef D2D_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "writer.h"
+
+struct AsyncWriter::Encoder {
+#ifdef D2D_HAVE_ZLIB
+    z_stream z;
+    bool z_init;
+#endif
+#ifdef D2D_HAVE_ZSTD
+    ZSTD_CStream *zstd;
+#endif
+    Encoder()
+    {
+#ifdef D2D_HAVE_ZLIB
+        z_init = false;
+#endif
+#ifdef D2D_HAVE_ZSTD
+        zstd = nullptr;
+#endif
+    }
+    ~Encoder()
+    {
+#ifdef D2D_HAVE_ZLIB
+        if (z_init) deflateEnd(&z);
+#endif
+#ifdef D2D_HAVE_ZSTD
+        if (zstd != nullptr) ZSTD_freeCStream(zstd);
+#endif
+    }
+};
+
+AsyncWriter::AsyncWriter(size_t buffer_size_, size_t queue_limit_)
+    : file(nullptr),
+    codec_(BlockReader::CODEC_PLAIN),
+    queue_limit(queue_limit_ < 1 ? 1 : queue_limit_),
+    buffer_size(buffer_size_),
+    done(false),
+    written(0),
+    file_bytes(0),
+    busy_seconds(0)
+{
+}
+
+AsyncWriter::~AsyncWriter()
+{
+    close();
+}
+
+BlockReader::Codec AsyncWriter::codec_for(const std::string &path)
+{
+    auto ends_with = [&path](const char *suffix) {
+        size_t n = std::strlen(suffix);
+        return path.size() > n && path.compare(path.size() - n, n, suffix) == 0;
+    };
+    if (ends_with(".gz")) return BlockReader::CODEC_GZIP;
+    if (ends_with(".zst")) return BlockReader::CODEC_ZSTD;
+    return BlockReader::CODEC_PLAIN;
+}
+
+bool AsyncWriter::parse_codec(const std::string &text, const std::string &path, BlockReader::Codec &codec, int &level)
+{
+    level = 0;
+    if (text.empty()) {
+        codec = codec_for(path);
+        return true;
+    }
+    auto colon = text.find(':');
+    auto name = text.substr(0, colon);
+    if (name == "none") codec = BlockReader::CODEC_PLAIN;
+    else if (name == "gzip") codec = BlockReader::CODEC_GZIP;
+    else if (name == "zstd") codec = BlockReader::CODEC_ZSTD;
+    else return false;
+    if (colon != std::string::npos) {
+        char *end = nullptr;
+        level = static_cast<int>(std::strtol(text.c_str() + colon + 1, &end, 10));
+        if (end == text.c_str() + colon + 1 || *end != '\0') return false;
+    }
+    return true;
+}
+
+bool AsyncWriter::open(const std::string &path, BlockReader::Codec codec, int level)
+{
+    close();
+    codec_ = codec;
+    encoder.reset(new Encoder());
+    error_.clear();
+    switch (codec) {
+    case BlockReader::CODEC_GZIP:
+#ifdef D2D_HAVE_ZLIB
+        std::memset(&encoder->z, 0, sizeof(encoder->z));
+        encoder->z_init = deflateInit2(&encoder->z, level == 0 ? Z_DEFAULT_COMPRESSION : level,
+            Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        if (!encoder->z_init) error_ = "failed to initialize zlib";
+#else
+        error_ = "gzip output needs zlib support";
+#endif
+        break;
+    case BlockReader::CODEC_ZSTD:
+#ifdef D2D_HAVE_ZSTD
+        encoder->zstd = ZSTD_createCStream();
+        if (encoder->zstd == nullptr || ZSTD_isError(ZSTD_initCStream(encoder->zstd, level))) {
+            error_ = "failed to initialize zstd";
+        }
+#else
+        error_ = "zstd output needs libzstd support";
+#endif
+        break;
+    default:
+        break;
+    }
+    if (!error_.empty()) return false;
+
+    file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        error_ = "failed to open " + path;
+        return false;
+    }
+    out.resize(codec == BlockReader::CODEC_PLAIN ? 0 : buffer_size);
+    written = file_bytes = 0;
+    busy_seconds = 0;
+    done = false;
+    current.resize(buffer_size);
+    setp(current.data(), current.data() + current.size());
+    thread = std::thread(&AsyncWriter::run, this);
+    return true;
+}
+
+void AsyncWriter::push()
+{
+    current.resize(pptr() - pbase());
+    written += current.size();
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        drained.wait(guard, [this]() {
+            return queue.size() < queue_limit;
+        });
+        if (!current.empty()) queue.push_back(std::move(current));
+        current.clear();
+        if (!spare.empty()) {
+            current = std::move(spare.back());
+            spare.pop_back();
+        }
+    }
+    queued.notify_all();
+    current.resize(buffer_size);
+    setp(current.data(), current.data() + current.size());
+}
+
+AsyncWriter::int_type AsyncWriter::overflow(int_type c)
+{
+    if (!thread.joinable()) return traits_type::eof();
+    push();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int AsyncWriter::sync()
+{
+    /* left to close(), or every std::endl would hand a line to the thread */
+    return 0;
+}
+
+bool AsyncWriter::close()
+{
+    if (thread.joinable()) {
+        push();
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            done = true;
+        }
+        queued.notify_all();
+        thread.join();
+        setp(nullptr, nullptr);
+    }
+    if (file != nullptr) {
+        if (std::fclose(file) != 0 && error_.empty()) error_ = "failed to close the output";
+        file = nullptr;
+    }
+    return error_.empty();
+}
+
+void AsyncWriter::run()
+{
+    for (;;) {
+        std::vector<char> buf;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            queued.wait(guard, [this]() {
+                return done || !queue.empty();
+            });
+            if (queue.empty()) break;
+            buf = std::move(queue.front());
+            queue.pop_front();
+        }
+        drained.notify_all();
+
+        auto start = std::chrono::steady_clock::now();
+        /* after an error the rest is dropped, but still taken off the queue */
+        if (error_.empty()) encode(buf.data(), buf.size(), false);
+        busy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> guard(lock);
+        spare.push_back(std::move(buf));
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (error_.empty()) encode(nullptr, 0, true);
+    busy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool AsyncWriter::write(const char *data, size_t size)
+{
+    if (size > 0 && std::fwrite(data, 1, size, file) != size) {
+        error_ = "failed to write the output";
+        return false;
+    }
+    file_bytes += size;
+    return true;
+}
+
+bool AsyncWriter::encode(const char *data, size_t size, bool finish)
+{
+    switch (codec_) {
+#ifdef D2D_HAVE_ZLIB
+    case BlockReader::CODEC_GZIP: {
+        auto &z = encoder->z;
+        z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        z.avail_in = static_cast<uInt>(size);
+        int ret;
+        do {
+            z.next_out = reinterpret_cast<Bytef*>(out.data());
+            z.avail_out = static_cast<uInt>(out.size());
+            ret = deflate(&z, finish ? Z_FINISH : Z_NO_FLUSH);
+            if (ret == Z_STREAM_ERROR) {
+                error_ = "gzip compression failed";
+                return false;
+            }
+            if (!write(out.data(), out.size() - z.avail_out)) return false;
+        } while (z.avail_out == 0 || (finish && ret != Z_STREAM_END));
+        return true;
+    }
+#endif
+#ifdef D2D_HAVE_ZSTD
+    case BlockReader::CODEC_ZSTD: {
+        ZSTD_inBuffer input = { data, size, 0 };
+        size_t left;
+        do {
+            ZSTD_outBuffer output = { out.data(), out.size(), 0 };
+            left = finish ? ZSTD_endStream(encoder->zstd, &output)
+                : ZSTD_compressStream(encoder->zstd, &output, &input);
+            if (ZSTD_isError(left)) {
+                error_ = std::string("zstd compression failed: ") + ZSTD_getErrorName(left);
+                return false;
+            }
+            if (!write(out.data(), output.pos)) return false;
+        } while (finish ? left > 0 : input.pos < input.size);
+        return true;
+    }
+#endif
+    default:
+        return write(data, size);
+    }
+}
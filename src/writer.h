@@ -0,0 +1,109 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_WRITER_H
+#define D2D_WRITER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "reader.h"
+
+/* Output stage of the exports: a stream buffer whose full buffers are
+ * handed through a bounded queue to a writer thread, which compresses them
+ * when asked to and writes them out. Formatting goes on while the previous
+ * buffers are compressed and written.
+ *
+ * Install it with static_cast<std::ostream&>(ofile).rdbuf(&writer). Flushes
+ * (std::endl) do not reach the file, everything is written by close() */
+class AsyncWriter : public std::streambuf {
+private:
+    struct Encoder;
+
+    std::FILE *file;
+    BlockReader::Codec codec_;
+    std::unique_ptr<Encoder> encoder;
+    std::vector<char> out; /* compressed bytes */
+
+    std::vector<char> current;
+    std::deque<std::vector<char>> queue;
+    std::vector<std::vector<char>> spare;
+    size_t queue_limit;
+    size_t buffer_size;
+    bool done;
+    std::string error_;
+    std::mutex lock;
+    std::condition_variable queued;
+    std::condition_variable drained;
+    std::thread thread;
+
+    uint64_t written; /* bytes handed to the writer */
+    uint64_t file_bytes;
+    double busy_seconds;
+
+    void push();
+    void run();
+    bool encode(const char *data, size_t size, bool finish);
+    bool write(const char *data, size_t size);
+protected:
+    int_type overflow(int_type c) override;
+    int sync() override;
+public:
+    AsyncWriter(size_t buffer_size_ = 1 << 20, size_t queue_limit_ = 4);
+    ~AsyncWriter();
+
+    /* the codec of an output named `path', told by its extension */
+    static BlockReader::Codec codec_for(const std::string &path);
+    /* "none", "gzip" or "zstd", optionally followed by ":level". Empty
+     * picks the codec by the extension of `path' */
+    static bool parse_codec(const std::string &text, const std::string &path, BlockReader::Codec &codec, int &level);
+    /* `level' 0 is the codec's default */
+    bool open(const std::string &path, BlockReader::Codec codec, int level = 0);
+    /* writes what is left and waits for the thread, false on any error */
+    bool close();
+
+    BlockReader::Codec codec() const
+    {
+        return codec_;
+    }
+    const std::string &error() const
+    {
+        return error_;
+    }
+    uint64_t bytes() const
+    {
+        return written;
+    }
+    uint64_t compressed_bytes() const
+    {
+        return file_bytes;
+    }
+    /* time the thread spent compressing and writing */
+    double write_seconds() const
+    {
+        return busy_seconds;
+    }
+};
+
+#endif //D2D_WRITER_H
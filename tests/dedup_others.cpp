@@ -0,0 +1,121 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+/* With --dedup --coarsen, a sibling drawn through its identical
+ * representative is not one of the "others": under a root with three
+ * identical children, each child is written once or summed up once, for
+ * -m cutting before, inside and after the identical ones */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "cmd_parse.h"
+#include "dump.h"
+#include "test_dump.h"
+
+namespace {
+    /* a root with one child of 1000 bytes, three identical ones of 500,
+     * one of 300 and ten small ones */
+    const size_t children = 15;
+
+    bool write(const std::string &path)
+    {
+        std::FILE *fo = std::fopen(path.c_str(), "w");
+        if (fo == nullptr) return false;
+        std::fprintf(fo, "0x%llx,(nil),0,16,(null),root\n", test_dump::label(0));
+        const unsigned sizes[] = { 1000, 500, 500, 500, 300 };
+        for (uint64_t i = 1; i <= children; i++) {
+            unsigned size = i <= 5 ? sizes[i - 1] : static_cast<unsigned>(10 + i);
+            std::fprintf(fo, "0x%llx,0x%llx,1,%u,field,%s\n", test_dump::label(i), test_dump::label(0),
+                size, size == 500 ? "same" : ("leaf" + std::to_string(i)).c_str());
+        }
+        std::fclose(fo);
+        return true;
+    }
+}
+
+int main()
+{
+    std::string path = test_dump::scratch("dedup-others.txt");
+    std::string out = test_dump::scratch("dedup-others.dot");
+    if (!write(path)) {
+        std::cout << "Failed to write " << path << std::endl;
+        return EXIT_FAILURE;
+    }
+    MemoryDump dump;
+    dump.import(path);
+    dump.set_hash_consing(true);
+    dump.update_subtree_size();
+    /* the only child of NIL */
+    const Node &root = *dump.top_level().front().node->children.front().node;
+
+    int failures = 0;
+    for (int m = 1; m <= 6; m++) {
+        cmd_opt opt;
+        opt.ofile = out;
+        opt.columns_export = true;
+        opt.dedup = true;
+        opt.coarsen = true;
+        opt.max_subnodes = m;
+        ColumnTables tables;
+        std::string error;
+        if (!dump.write_output(opt) || !tables.read(out, error)) {
+            std::cout << "Failed to read " << out << ": " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::map<uint64_t, size_t> row;
+        for (size_t i = 0; i < tables.node_count(); i++) row[tables.label[i]] = i;
+
+        /* the children and bytes under the root, counting each edge as
+         * many times as its " xN" says and an "others" node as its N */
+        size_t count = 0;
+        double bytes = 0;
+        for (size_t i = 0; i < tables.edge_count(); i++) {
+            if (tables.parent[i] != root.label) continue;
+            size_t n = 1;
+            auto r = row[tables.child[i]];
+            std::string name = tables.name[r] == ColumnTables::NO_STRING ? "" : tables.strings[tables.name[r]];
+            if (name.find(" others (") != std::string::npos) {
+                n = std::strtoul(name.c_str(), nullptr, 10);
+                bytes += tables.subtree_size[r];
+            }
+            else {
+                std::string edge = tables.edge[i] == ColumnTables::NO_STRING ? "" : tables.strings[tables.edge[i]];
+                auto x = edge.rfind('x');
+                if (x != std::string::npos && (x == 0 || edge[x - 1] == ' ')) {
+                    n = std::strtoul(edge.c_str() + x + 1, nullptr, 10);
+                }
+                bytes += n * tables.subtree_size[r];
+            }
+            count += n;
+        }
+        double expected = root.subtree_size - root.size;
+        bool ok = count == children && std::fabs(bytes - expected) <= 0.5;
+        std::cout << "-m " << m << ": " << count << " children, " << bytes << " bytes, expected "
+            << children << ", " << expected << (ok ? "" : " MISMATCH") << std::endl;
+        if (!ok) ++failures;
+        std::remove((out + ".nodes").c_str());
+        std::remove((out + ".edges").c_str());
+        std::remove((out + ".strings").c_str());
+    }
+    std::remove(path.c_str());
+    std::remove(out.c_str());
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
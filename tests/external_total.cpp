@@ -0,0 +1,109 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+/* The out-of-core import has to size the dump like the in-memory one:
+ * imports a generated dump with shared nodes and cycles both ways and
+ * compares the totals, then the subtree_size and the parents chosen of
+ * every node */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "dump.h"
+#include "external.h"
+#include "test_dump.h"
+
+namespace {
+    struct Sized {
+        double subtree_size;
+        std::vector<uintptr_t> parents; /* linked, sorted */
+    };
+
+    /* every node reachable from the top nodes */
+    std::map<uintptr_t, Sized> sizes(const MemoryDump &dump)
+    {
+        std::map<uintptr_t, Sized> ret;
+        std::vector<const Node*> work;
+        for (const auto &c : dump.top_level()) {
+            ret[c.node->label].subtree_size = c.node->subtree_size;
+            work.push_back(c.node);
+        }
+        while (!work.empty()) {
+            auto node = work.back();
+            work.pop_back();
+            for (const auto &c : node->children) {
+                auto iter = ret.find(c.node->label);
+                if (iter == ret.end()) {
+                    iter = ret.insert(std::make_pair(c.node->label, Sized())).first;
+                    iter->second.subtree_size = c.node->subtree_size;
+                    work.push_back(c.node);
+                }
+                iter->second.parents.push_back(node->label);
+            }
+        }
+        for (auto &&pair : ret) {
+            std::sort(pair.second.parents.begin(), pair.second.parents.end());
+        }
+        return ret;
+    }
+}
+
+int main()
+{
+    std::string path = test_dump::scratch("external-total.txt");
+    int failures = 0;
+    for (uint64_t seed = 1; seed <= 3; seed++) {
+        if (!test_dump::write(path, 20000, seed, true)) {
+            std::cout << "Failed to write " << path << std::endl;
+            return EXIT_FAILURE;
+        }
+        MemoryDump dump;
+        dump.import(path);
+        double in_memory = dump.update_subtree_size(false);
+
+        ExternalDump external(1 << 20);
+        MemoryDump loaded;
+        if (!external.import(path) || !external.load(loaded, 0, std::vector<uintptr_t>())) {
+            std::cout << "Out-of-core import failed" << std::endl;
+            return EXIT_FAILURE;
+        }
+        double out_of_core = external.total();
+        auto expected = sizes(dump);
+        auto got = sizes(loaded);
+        size_t sized = got.size() == expected.size() ? 0 : 1, linked = 0;
+        for (const auto &pair : expected) {
+            auto iter = got.find(pair.first);
+            if (iter == got.end()) {
+                ++sized;
+                continue;
+            }
+            if (std::fabs(iter->second.subtree_size - pair.second.subtree_size) > 1e-9 * pair.second.subtree_size) ++sized;
+            if (iter->second.parents != pair.second.parents) ++linked;
+        }
+        bool ok = std::fabs(in_memory - out_of_core) <= 1e-9 * in_memory && sized == 0 && linked == 0;
+        std::cout << "seed " << seed << ": " << in_memory << " in memory, " << out_of_core << " out of core, "
+            << sized << " nodes sized and " << linked << " linked differently" << (ok ? "" : " MISMATCH") << std::endl;
+        if (!ok) ++failures;
+    }
+    std::remove(path.c_str());
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,140 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+/* follow() resizes only what the appended records touch: after each tick
+ * the sizes have to be those of a fresh import of the same file. With
+ * cycles, the edge that closes one depends on the order of the children,
+ * which relinking changes: only the totals are compared */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "dump.h"
+#include "test_dump.h"
+
+namespace {
+    struct Sized {
+        double subtree_size;
+        short division;
+    };
+
+    /* the sizes of every node reachable from the top nodes */
+    std::map<uintptr_t, Sized> sizes(const MemoryDump &dump)
+    {
+        std::map<uintptr_t, Sized> ret;
+        std::vector<const Node*> work;
+        for (const auto &c : dump.top_level()) work.push_back(c.node);
+        while (!work.empty()) {
+            auto node = work.back();
+            work.pop_back();
+            Sized s = { node->subtree_size, node->subtree_size_division };
+            if (!ret.insert(std::make_pair(node->label, s)).second) continue;
+            for (const auto &c : node->children) work.push_back(c.node);
+        }
+        return ret;
+    }
+
+    double top_total(const MemoryDump &dump)
+    {
+        double total = 0;
+        for (const auto &c : dump.top_level()) {
+            total += c.node->subtree_size / c.node->subtree_size_division;
+        }
+        return total;
+    }
+
+    size_t compare(const MemoryDump &followed, const MemoryDump &fresh)
+    {
+        auto a = sizes(followed);
+        auto b = sizes(fresh);
+        size_t bad = a.size() == b.size() ? 0 : 1;
+        for (const auto &pair : b) {
+            auto iter = a.find(pair.first);
+            if (iter == a.end()
+                || iter->second.division != pair.second.division
+                || std::fabs(iter->second.subtree_size - pair.second.subtree_size) > 1e-9 * pair.second.subtree_size) {
+                ++bad;
+            }
+        }
+        return bad;
+    }
+
+    /* the failed ticks */
+    int follow_ticks(bool loops)
+    {
+        std::string path = test_dump::scratch("follow-sizes.txt");
+        std::string full = test_dump::scratch("follow-sizes-full.txt");
+        if (!test_dump::write(full, 20000, 11, loops)) {
+            std::cout << "Failed to write " << full << std::endl;
+            return 1;
+        }
+        std::vector<std::string> lines;
+        {
+            std::ifstream fi(full);
+            std::string line;
+            while (std::getline(fi, line)) lines.push_back(line);
+        }
+        /* the appended records come in any order: children before their
+         * parents, and new parents for nodes imported already */
+        std::mt19937_64 rng(11);
+        std::shuffle(lines.begin() + lines.size() / 2, lines.end(), rng);
+
+        std::ofstream fo(path);
+        size_t written = 0;
+        auto append = [&](size_t end) {
+            for (; written < end; written++) fo << lines[written] << "\n";
+            fo.flush();
+        };
+        append(lines.size() / 2);
+
+        MemoryDump dump;
+        dump.import(path);
+        dump.update_subtree_size();
+        int failures = 0;
+        const size_t ticks[] = { lines.size() / 2 + 1, lines.size() * 3 / 4, lines.size() };
+        for (auto end : ticks) {
+            append(end);
+            dump.follow();
+            MemoryDump fresh;
+            fresh.import(path);
+            double total = fresh.update_subtree_size();
+            double followed = top_total(dump);
+            size_t bad = loops ? 0 : compare(dump, fresh);
+            bool ok = bad == 0 && std::fabs(followed - total) <= 1e-9 * total;
+            std::cout << (loops ? "cycles, " : "acyclic, ") << written << " records: " << bad
+                << " nodes sized differently, total " << followed << " vs " << total
+                << (ok ? "" : " MISMATCH") << std::endl;
+            if (!ok) ++failures;
+        }
+        std::remove(path.c_str());
+        std::remove(full.c_str());
+        return failures;
+    }
+}
+
+int main()
+{
+    int failures = follow_ticks(false) + follow_ticks(true);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,75 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+#ifndef D2D_TEST_DUMP_H
+#define D2D_TEST_DUMP_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+/* generated dumps for the tests */
+namespace test_dump {
+    /* a file under $TMPDIR, or /tmp */
+    inline std::string scratch(const std::string &name)
+    {
+        const char *tmp = std::getenv("TMPDIR");
+        return std::string(tmp != nullptr ? tmp : "/tmp") + "/d2d-" + name;
+    }
+
+    inline unsigned long long label(uint64_t i)
+    {
+        return static_cast<unsigned long long>(0x10000 + i * 64);
+    }
+
+    /* a forest, plus extra parents for some nodes and, with `loops', edges
+     * from some nodes back up to one of their ancestors */
+    inline bool write(const std::string &path, uint64_t nodes, uint64_t seed, bool loops)
+    {
+        std::FILE *fo = std::fopen(path.c_str(), "w");
+        if (fo == nullptr) return false;
+        std::mt19937_64 rng(seed);
+        std::uniform_real_distribution<double> uniform(0, 1);
+        std::vector<uint64_t> parent(nodes, 0);
+        for (uint64_t i = 0; i < nodes; i++) {
+            unsigned size = 16 + static_cast<unsigned>(rng() % 48);
+            if (i == 0 || uniform(rng) < 0.01) {
+                std::fprintf(fo, "0x%llx,(nil),0,%u,(null),root%llu\n", label(i), size, label(i));
+                parent[i] = i;
+                continue;
+            }
+            parent[i] = rng() % i;
+            std::fprintf(fo, "0x%llx,0x%llx,1,%u,field,node\n", label(i), label(parent[i]), size);
+            if (uniform(rng) < 0.05) {
+                std::fprintf(fo, "0x%llx,0x%llx,1,%u,field,node\n", label(i), label(rng() % i), size);
+            }
+            if (loops && uniform(rng) < 0.02 && parent[i] != i) {
+                /* an ancestor of i gets i as one more parent */
+                uint64_t a = parent[i];
+                while (parent[a] != a && uniform(rng) < 0.5) a = parent[a];
+                if (parent[a] != a) {
+                    std::fprintf(fo, "0x%llx,0x%llx,1,%u,field,node\n", label(a), label(i), 16u);
+                }
+            }
+        }
+        std::fclose(fo);
+        return true;
+    }
+}
+
+#endif //D2D_TEST_DUMP_H
@@ -0,0 +1,96 @@
+/*
+**  Copyright 2016 Atronix Engineering, Inc
+**
+**  Licensed under the Apache License, Version 2.0 (the "License");
+**  you may not use this file except in compliance with the License.
+**  You may obtain a copy of the License at
+**
+**  http://www.apache.org/licenses/LICENSE-2.0
+**
+**  Unless required by applicable law or agreed to in writing, software
+**  distributed under the License is distributed on an "AS IS" BASIS,
+**  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+**  See the License for the specific language governing permissions and
+**  limitations under the License.
+*/
+
+/* -e FOLDED writes every byte of the dump once, whatever -t, -m and -d
+ * leave out: the stacks of a generated dump with shared nodes, with and
+ * without cycles, have to add up to its total */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "cmd_parse.h"
+#include "dump.h"
+#include "test_dump.h"
+
+namespace {
+    /* the sum of the counts and the number of stacks */
+    bool read_folded(const std::string &path, double &sum, size_t &lines)
+    {
+        std::ifstream fi(path);
+        if (!fi.good()) return false;
+        sum = 0;
+        lines = 0;
+        std::string line;
+        while (std::getline(fi, line)) {
+            auto space = line.rfind(' ');
+            if (space == std::string::npos) return false;
+            sum += std::atof(line.c_str() + space + 1);
+            ++lines;
+        }
+        return true;
+    }
+}
+
+int main()
+{
+    std::string path = test_dump::scratch("tree-total.txt");
+    std::string out = test_dump::scratch("tree-total.folded");
+    const double thresholds[] = { 0, 0.0005, 0.001, 0.01, 0.05 };
+    int failures = 0;
+    for (int loops = 0; loops < 2; loops++) {
+        if (!test_dump::write(path, 20000, 7, loops != 0)) {
+            std::cout << "Failed to write " << path << std::endl;
+            return EXIT_FAILURE;
+        }
+        MemoryDump dump;
+        dump.import(path);
+        double total = dump.update_subtree_size();
+        for (int indexed = 0; indexed < 2; indexed++) {
+            if (indexed) dump.build_levels();
+            for (auto t : thresholds) {
+                for (int limits = 0; limits < 2; limits++) {
+                    cmd_opt opt;
+                    opt.ofile = out;
+                    opt.tree_export = TREE_EXPORT_FOLDED;
+                    opt.threshold = t;
+                    if (limits) {
+                        opt.max_subnodes = 3;
+                        opt.depth = 6;
+                    }
+                    double sum = 0;
+                    size_t lines = 0;
+                    if (!dump.write_output(opt) || !read_folded(out, sum, lines)) {
+                        std::cout << "Failed to write " << out << std::endl;
+                        return EXIT_FAILURE;
+                    }
+                    /* each stack is rounded to a whole byte */
+                    bool ok = std::fabs(sum - total) <= 0.5 * lines + 1e-9 * total;
+                    std::cout << (loops ? "cycles" : "acyclic") << (indexed ? ", indexed" : "")
+                        << ", -t " << t << (limits ? " -m 3 -d 6" : "") << ": " << sum << " in "
+                        << lines << " stacks, total " << total << (ok ? "" : " MISMATCH") << std::endl;
+                    if (!ok) ++failures;
+                }
+            }
+        }
+    }
+    std::remove(path.c_str());
+    std::remove(out.c_str());
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}